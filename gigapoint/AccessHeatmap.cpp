@@ -0,0 +1,87 @@
+#include "AccessHeatmap.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define HEATMAP_DECAY 0.5f		// weight of the earlier sessions
+#define HEATMAP_MIN_MS 1.0f		// colder nodes are dropped from the file
+
+AccessHeatmap::AccessHeatmap(const string& fn): filename(fn), numLoaded(0) {
+	lastSave = Utils::getTime();
+}
+
+AccessHeatmap::~AccessHeatmap() {
+}
+
+bool AccessHeatmap::load() {
+	ifstream in(filename.c_str());
+	if(!in.is_open())
+		return false;
+	string name;
+	float ms;
+	numLoaded = 0;
+	while(in >> name >> ms) {
+		heat[name] += ms * HEATMAP_DECAY;
+		numLoaded++;
+	}
+	cout << "Access heatmap: " << numLoaded << " nodes from " << filename << endl;
+	return numLoaded > 0;
+}
+
+static bool hotter(const pair<float, string>& a, const pair<float, string>& b) {
+	return a.first > b.first;
+}
+
+void AccessHeatmap::getHottest(vector<string>& names, int maxnodes) {
+	vector<pair<float, string> > order;
+	order.reserve(heat.size());
+	for(map<string, float>::iterator it = heat.begin(); it != heat.end(); it++)
+		if(it->second >= HEATMAP_MIN_MS)
+			order.push_back(make_pair(it->second, it->first));
+	sort(order.begin(), order.end(), hotter);
+	if(order.size() > maxnodes)
+		order.resize(maxnodes);
+	names.clear();
+	for(int i=0; i < order.size(); i++)
+		names.push_back(order[i].second);
+}
+
+// written to a temporary file first, so a crash does not leave half a heatmap
+bool AccessHeatmap::save(int maxnodes) {
+	lastSave = Utils::getTime();
+	vector<string> names;
+	getHottest(names, maxnodes);
+	string tmp = filename + ".tmp";
+	ofstream out(tmp.c_str());
+	if(!out.is_open()) {
+		cout << "Access heatmap: cannot write " << tmp << endl;
+		return false;
+	}
+	for(int i=0; i < names.size(); i++)
+		out << names[i] << " " << heat[names[i]] << "\n";
+	out.close();
+	if(rename(tmp.c_str(), filename.c_str()) != 0) {
+		cout << "Access heatmap: cannot write " << filename << endl;
+		return false;
+	}
+	return true;
+}
+
+void AccessHeatmap::saveEvery(unsigned int interval) {
+	if(Utils::getTime() - lastSave >= interval)
+		save();
+}
+
+void AccessHeatmap::printInfo() {
+	cout << "access heatmap: " << filename << " nodes: " << heat.size() << " (" << numLoaded << " from earlier sessions)"
+		 << endl;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,45 @@
+#ifndef _ACCESS_HEATMAP_H_
+#define _ACCESS_HEATMAP_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace gigapoint {
+
+#define HEATMAP_SAVE_INTERVAL 60000	// ms between saves during a session
+
+// Time on screen of every node over the sessions on a dataset, kept in a
+// side-car file of "name ms" lines. The counts of earlier sessions are halved
+// when the file is loaded, so the heat follows recent use. The hottest nodes
+// warm the cache on the next startup. Render thread only.
+class AccessHeatmap {
+
+private:
+	std::string filename;
+	std::map<std::string, float> heat;	// ms on screen
+	unsigned int lastSave;			// ms
+	int numLoaded;
+
+public:
+	AccessHeatmap(const std::string& filename);
+	~AccessHeatmap();
+
+	// merges the file with halved counts, false if there is none
+	bool load();
+	// writes the hottest maxnodes nodes
+	bool save(int maxnodes = 100000);
+	// saves if interval ms passed since the last save
+	void saveEvery(unsigned int interval);
+
+	void add(const std::string& name, float ms) { heat[name] += ms; }
+	// names of the nodes from hottest to coldest
+	void getHottest(std::vector<std::string>& names, int maxnodes);
+	int size() { return heat.size(); }
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
@@ -0,0 +1,132 @@
+#include "BatchRenderer.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace gigapoint {
+
+BatchRenderer::BatchRenderer(BufferPool* p): pool(p), indirectBuffer(0), indirectSize(0), initialized(false),
+											 useIndirect(false), changed(true), numNodes(0), numDrawCalls(0) {
+}
+
+BatchRenderer::~BatchRenderer() {
+}
+
+void BatchRenderer::init() {
+	initialized = true;
+	useIndirect = GLEW_ARB_multi_draw_indirect && GLEW_ARB_draw_indirect;
+	if(useIndirect)
+		glGenBuffers(1, &indirectBuffer);
+	cout << "Batch renderer: " << (useIndirect ? "glMultiDrawArraysIndirect" : "glMultiDrawArrays") << endl;
+}
+
+void BatchRenderer::begin() {
+	int numpages = pool->getNumPages();
+	if(firsts.size() < numpages) {
+		firsts.resize(numpages);
+		counts.resize(numpages);
+	}
+	for(int p=0; p < firsts.size(); p++) {
+		firsts[p].clear();
+		counts[p].clear();
+	}
+	numNodes = 0;
+	changed = true;
+}
+
+void BatchRenderer::add(NodeGeometry* node) {
+	if(node->isLoading() || !node->isLoaded() || !node->hasVBO())
+		return;
+	const BufferRange& range = node->getBufferRange();
+	firsts[range.page].push_back(range.first);
+	counts[range.page].push_back(node->getDrawCount());
+	node->setDrawn();
+	numNodes++;
+}
+
+void BatchRenderer::draw(Material* material) {
+	if(!initialized)
+		init();
+
+	numDrawCalls = 0;
+	if(numNodes == 0)
+		return;
+
+	Shader* shader = material->getShader();
+	Option* option = material->getOption();
+	ColorTexture* texture = ((MaterialPoint*)material)->getColorTexture();
+	shader->bind();
+	texture->bind();
+	((MaterialPoint*)material)->transmitUniforms();
+
+	unsigned int attribute_vertex_pos = shader->attribute(ATTR_POINT_POSITION);
+	unsigned int attribute_color_pos = shader->attribute(ATTR_POINT_COLOR);
+	bool rgb = option->material == MATERIAL_RGB;
+	glEnableVertexAttribArray(attribute_vertex_pos);
+	if(rgb)
+		glEnableVertexAttribArray(attribute_color_pos);
+
+	// one command list for all pages, each page draws its own slice, uploaded once per batch
+	if(useIndirect && changed) {
+		commands.resize(numNodes);
+		int c = 0;
+		for(int p=0; p < firsts.size(); p++) {
+			for(int i=0; i < firsts[p].size(); i++, c++) {
+				commands[c].count = counts[p][i];
+				commands[c].instanceCount = 1;
+				commands[c].first = firsts[p][i];
+				commands[c].baseInstance = 0;
+			}
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		if(indirectSize < numNodes) {
+			indirectSize = numNodes * 2;
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectSize * sizeof(DrawArraysIndirectCommand), NULL, GL_STREAM_DRAW);
+		}
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, numNodes * sizeof(DrawArraysIndirectCommand), &commands[0]);
+		changed = false;
+	} else if(useIndirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	}
+
+	int offset = 0;
+	for(int p=0; p < firsts.size(); p++) {
+		int n = firsts[p].size();
+		if(n == 0)
+			continue;
+
+		glBindBuffer(GL_ARRAY_BUFFER, pool->getBuffer(p));
+		glVertexAttribPointer(attribute_vertex_pos, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		if(rgb)
+			glVertexAttribPointer(attribute_color_pos, 3, GL_UNSIGNED_BYTE, GL_FALSE, 0,
+								  (const GLvoid*)(size_t)(pool->getCapacity(p) * POOL_VERTEX_SIZE));
+
+		if(useIndirect)
+			glMultiDrawArraysIndirect(GL_POINTS, (const GLvoid*)(size_t)(offset * sizeof(DrawArraysIndirectCommand)), n, 0);
+		else
+			glMultiDrawArrays(GL_POINTS, &firsts[p][0], &counts[p][0], n);
+		offset += n;
+		numDrawCalls++;
+	}
+
+	if(useIndirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glDisableVertexAttribArray(attribute_vertex_pos);
+	if(rgb)
+		glDisableVertexAttribArray(attribute_color_pos);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	shader->unbind();
+	texture->unbind();
+}
+
+void BatchRenderer::destroy() {
+	if(indirectBuffer)
+		glDeleteBuffers(1, &indirectBuffer);
+	indirectBuffer = 0;
+	indirectSize = 0;
+	initialized = false;
+	changed = true;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,59 @@
+#ifndef _BATCH_RENDERER_H_
+#define _BATCH_RENDERER_H_
+
+#include "NodeGeometry.h"
+#include "BufferPool.h"
+#include "Material.h"
+
+#include <vector>
+
+namespace gigapoint {
+
+// layout of glMultiDrawArraysIndirect commands
+struct DrawArraysIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
+};
+
+// Draws the whole display list with one multi-draw per buffer pool page.
+// A batch is kept until begin is called again and can be drawn many times.
+// Shader, texture and uniforms are set once per frame and attribute pointers
+// once per page. The per-node ranges are kept in an indirect command buffer
+// when ARB_multi_draw_indirect is available, glMultiDrawArrays is used otherwise.
+class BatchRenderer {
+
+private:
+	BufferPool* pool;
+	std::vector< std::vector<GLint> > firsts;		// per page
+	std::vector< std::vector<GLsizei> > counts;		// per page
+	std::vector<DrawArraysIndirectCommand> commands;
+	unsigned int indirectBuffer;
+	unsigned int indirectSize;		// commands
+	bool initialized;
+	bool useIndirect;
+	bool changed;		// commands not uploaded since begin
+
+	int numNodes;
+	int numDrawCalls;
+
+	void init();
+
+public:
+	BatchRenderer(BufferPool* pool);
+	~BatchRenderer();
+
+	void begin();
+	void add(NodeGeometry* node);
+	void draw(Material* material);
+	void destroy();
+
+	bool isIndirect() { return useIndirect; }
+	int getNumNodes() { return numNodes; }
+	int getNumDrawCalls() { return numDrawCalls; }
+};
+
+}; //namespace gigapoint
+
+#endif
@@ -0,0 +1,96 @@
+#include "BudgetGovernor.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <math.h>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define GOVERNOR_SMOOTH 0.1f		// weight of the newest frame in the average
+#define GOVERNOR_TOLERANCE 0.15f	// dead band around the target
+#define GOVERNOR_FRAMES 5			// consecutive frames out of band before a change
+#define GOVERNOR_DECREASE 0.85f		// multiplicative decrease when over target
+#define GOVERNOR_INCREASE 1.05f		// multiplicative increase when under target
+
+BudgetGovernor::BudgetGovernor(unsigned int points, float pixelsize, unsigned int minpoints, unsigned int maxpoints,
+							   float targetframetime): targetFrameTime(targetframetime), basePoints(points),
+							   basePixelSize(pixelsize), minPoints(minpoints), maxPoints(maxpoints), scale(1),
+							   frameTime(0), overFrames(0), underFrames(0), numChanges(0) {
+	setBase(points, pixelsize, minpoints, maxpoints);
+}
+
+void BudgetGovernor::setBase(unsigned int points, float pixelsize, unsigned int minpoints, unsigned int maxpoints) {
+	basePoints = points > 0 ? points : 1;
+	basePixelSize = pixelsize;
+	minPoints = minpoints > basePoints ? basePoints : minpoints;
+	maxPoints = maxpoints < basePoints ? basePoints : maxpoints;
+	scale = MAX((float)minPoints / basePoints, MIN((float)maxPoints / basePoints, scale));
+}
+
+BudgetGovernor::~BudgetGovernor() {
+}
+
+void BudgetGovernor::frame(float frametime, bool canincrease) {
+	if(frameTime == 0)
+		frameTime = frametime;
+	else
+		frameTime = (1 - GOVERNOR_SMOOTH) * frameTime + GOVERNOR_SMOOTH * frametime;
+
+	if(targetFrameTime <= 0) {
+		scale = 1;
+		overFrames = underFrames = 0;
+		return;
+	}
+
+	if(frameTime > targetFrameTime * (1 + GOVERNOR_TOLERANCE)) {
+		overFrames++;
+		underFrames = 0;
+	}
+	else if(frameTime < targetFrameTime * (1 - GOVERNOR_TOLERANCE) && canincrease) {
+		underFrames++;
+		overFrames = 0;
+	}
+	else {
+		overFrames = underFrames = 0;
+	}
+
+	float newscale = scale;
+	if(overFrames >= GOVERNOR_FRAMES) {
+		newscale *= GOVERNOR_DECREASE;
+		overFrames = 0;
+	}
+	else if(underFrames >= GOVERNOR_FRAMES) {
+		newscale *= GOVERNOR_INCREASE;
+		underFrames = 0;
+	}
+	newscale = MAX((float)minPoints / basePoints, MIN((float)maxPoints / basePoints, newscale));
+	if(newscale != scale) {
+		scale = newscale;
+		numChanges++;
+	}
+}
+
+void BudgetGovernor::setTargetFrameTime(float t) {
+	if(t == targetFrameTime)
+		return;
+	targetFrameTime = t;
+	overFrames = underFrames = 0;
+}
+
+unsigned int BudgetGovernor::getPointBudget() {
+	return basePoints * scale;
+}
+
+float BudgetGovernor::getMinNodePixelSize() {
+	return basePixelSize / sqrt(scale);
+}
+
+void BudgetGovernor::printInfo() {
+	cout << "budget: " << getPointBudget() << " points (" << minPoints << " - " << maxPoints << ")"
+		 << " minNodePixelSize: " << getMinNodePixelSize() << " frameTime: " << frameTime
+		 << " ms target: " << targetFrameTime << " ms changes: " << numChanges << endl;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,51 @@
+#ifndef _BUDGET_GOVERNOR_H_
+#define _BUDGET_GOVERNOR_H_
+
+namespace gigapoint {
+
+// Closed loop controller of the point budget. Scales visiblePointTarget
+// between minPoints and maxPoints to hold the smoothed frame time at the
+// target, minNodePixelSize is scaled with the square root so that detail
+// is given up in screen space at the same rate. A dead band and a number of
+// consecutive frames out of band are required before every change, so the
+// budget does not oscillate around the target. The budget is not raised while
+// the caller holds it, e.g. while the LoadThrottle cuts loads on the same
+// frame time. Render thread only.
+class BudgetGovernor {
+
+private:
+	float targetFrameTime;	// ms, 0 = disabled
+	unsigned int basePoints;	// visiblePointTarget
+	float basePixelSize;		// minNodePixelSize
+	unsigned int minPoints;
+	unsigned int maxPoints;
+
+	float scale;			// budget = basePoints * scale
+	float frameTime;		// smoothed frame time (ms)
+	int overFrames;			// consecutive frames over the band
+	int underFrames;		// consecutive frames under the band
+	int numChanges;
+
+public:
+	BudgetGovernor(unsigned int points, float pixelsize, unsigned int minpoints, unsigned int maxpoints,
+				   float targetframetime = 0);
+	~BudgetGovernor();
+
+	// called once per frame by the render thread, the budget is only raised with canincrease
+	void frame(float frametime, bool canincrease = true);
+
+	// visiblePointTarget, minNodePixelSize and pointBudgetRange, may change at run time
+	void setBase(unsigned int points, float pixelsize, unsigned int minpoints, unsigned int maxpoints);
+	void setTargetFrameTime(float t);
+	float getTargetFrameTime() { return targetFrameTime; }
+	float getFrameTime() { return frameTime; }
+	float getScale() { return scale; }
+	unsigned int getPointBudget();
+	float getMinNodePixelSize();
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
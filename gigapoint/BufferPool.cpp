@@ -0,0 +1,110 @@
+#include "BufferPool.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace gigapoint {
+
+BufferPool::BufferPool(unsigned int pagesize): numAllocs(0), numFrees(0) {
+	pageCapacity = pagesize / (POOL_VERTEX_SIZE + POOL_COLOR_SIZE);
+}
+
+BufferPool::~BufferPool() {
+}
+
+int BufferPool::createPage(unsigned int capacity) {
+	BufferPage page;
+	page.capacity = capacity;
+	page.freelist[0] = capacity;
+
+	glGenBuffers(1, &page.buffer);
+	if(!page.buffer)
+		return -1;
+	glBindBuffer(GL_ARRAY_BUFFER, page.buffer);
+	glBufferData(GL_ARRAY_BUFFER, capacity * (POOL_VERTEX_SIZE + POOL_COLOR_SIZE), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	pages.push_back(page);
+	cout << "Buffer pool: new page " << pages.size()-1 << " of " << capacity << " points" << endl;
+	return pages.size()-1;
+}
+
+bool BufferPool::allocate(unsigned int numpoints, BufferRange& range) {
+	if(numpoints == 0)
+		return false;
+
+	// first fit over all pages
+	for(int p=0; p < pages.size(); p++) {
+		BufferPage& page = pages[p];
+		if(page.capacity - page.used < numpoints)
+			continue;
+		for(map<unsigned int, unsigned int>::iterator it = page.freelist.begin(); it != page.freelist.end(); it++) {
+			if(it->second < numpoints)
+				continue;
+			range.page = p;
+			range.first = it->first;
+			range.count = numpoints;
+			if(it->second > numpoints)
+				page.freelist[it->first + numpoints] = it->second - numpoints;
+			page.freelist.erase(it);
+			page.used += numpoints;
+			numAllocs++;
+			return true;
+		}
+	}
+
+	// no space left, nodes bigger than a page get a page of their own
+	int p = createPage(numpoints > pageCapacity ? numpoints : pageCapacity);
+	if(p < 0)
+		return false;
+	return allocate(numpoints, range);
+}
+
+void BufferPool::free(BufferRange& range) {
+	if(!range.valid())
+		return;
+
+	BufferPage& page = pages[range.page];
+	map<unsigned int, unsigned int>::iterator it = page.freelist.insert(make_pair(range.first, range.count)).first;
+
+	// coalesce with the next and previous free ranges
+	map<unsigned int, unsigned int>::iterator next = it;
+	next++;
+	if(next != page.freelist.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		page.freelist.erase(next);
+	}
+	if(it != page.freelist.begin()) {
+		map<unsigned int, unsigned int>::iterator prev = it;
+		prev--;
+		if(prev->first + prev->second == it->first) {
+			prev->second += it->second;
+			page.freelist.erase(it);
+		}
+	}
+
+	page.used -= range.count;
+	numFrees++;
+	range = BufferRange();
+}
+
+void BufferPool::destroy() {
+	for(int p=0; p < pages.size(); p++)
+		glDeleteBuffers(1, &pages[p].buffer);
+	pages.clear();
+}
+
+void BufferPool::printInfo() {
+	unsigned int capacity = 0, used = 0, fragments = 0;
+	for(int p=0; p < pages.size(); p++) {
+		capacity += pages[p].capacity;
+		used += pages[p].used;
+		fragments += pages[p].freelist.size();
+	}
+	cout << "buffer pool: pages: " << pages.size() << " used: " << used << "/" << capacity << " points"
+		 << " (" << used * (POOL_VERTEX_SIZE + POOL_COLOR_SIZE) / (1024*1024) << " MB)"
+		 << " free ranges: " << fragments << " allocs: " << numAllocs << " frees: " << numFrees << endl;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,74 @@
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+
+#ifdef STANDALONE_APP
+#include "app/GLInclude.h"
+#else
+#include <omegaGl.h>
+#endif
+
+#include <map>
+#include <vector>
+
+namespace gigapoint {
+
+#define POOL_VERTEX_SIZE 12	// 3 floats
+#define POOL_COLOR_SIZE 3	// 3 unsigned bytes
+
+// a range of points inside one page of the pool
+struct BufferRange {
+	int page;
+	unsigned int first;		// first point in page
+	unsigned int count;		// number of points
+
+	BufferRange(): page(-1), first(0), count(0) {}
+	bool valid() const { return page >= 0; }
+};
+
+// one large GL buffer: positions of all points first, colours after them.
+// point i of the page has its position at i*12 and its colour at capacity*12 + i*3,
+// so all nodes of a page can be drawn with the same attribute pointers.
+struct BufferPage {
+	unsigned int buffer;
+	unsigned int capacity;		// points
+	unsigned int used;			// points
+	std::map<unsigned int, unsigned int> freelist;	// first point -> number of points
+
+	BufferPage(): buffer(0), capacity(0), used(0) {}
+};
+
+// GPU memory manager for node geometry. Carves node ranges out of a few
+// large buffers with a first-fit free list and coalesces freed ranges.
+// Render thread only.
+class BufferPool {
+
+private:
+	std::vector<BufferPage> pages;
+	unsigned int pageCapacity;	// points per page
+	int numAllocs;
+	int numFrees;
+
+	int createPage(unsigned int capacity);
+
+public:
+	BufferPool(unsigned int pagesize);	// page size in bytes
+	~BufferPool();
+
+	bool allocate(unsigned int numpoints, BufferRange& range);
+	void free(BufferRange& range);
+	void destroy();
+
+	int getNumPages() { return pages.size(); }
+	unsigned int getBuffer(int page) { return pages[page].buffer; }
+	unsigned int getCapacity(int page) { return pages[page].capacity; }
+	unsigned int getVertexOffset(const BufferRange& range) { return range.first * POOL_VERTEX_SIZE; }
+	unsigned int getColorOffset(const BufferRange& range) {
+		return pages[range.page].capacity * POOL_VERTEX_SIZE + range.first * POOL_COLOR_SIZE;
+	}
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
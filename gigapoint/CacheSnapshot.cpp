@@ -0,0 +1,188 @@
+#include "CacheSnapshot.h"
+#include "NodeGeometry.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define SNAPSHOT_ALIGN 8
+
+static size_t align(size_t n) {
+	return (n + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+CacheSnapshot::CacheSnapshot(const string& fn): filename(fn), fd(-1), data(NULL), size(0), numRestored(0) {
+	pthread_mutex_init(&mutex, NULL);
+}
+
+CacheSnapshot::~CacheSnapshot() {
+	close();
+	pthread_mutex_destroy(&mutex);
+}
+
+bool CacheSnapshot::open(const string& key) {
+	close();
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < 16) {
+		close();
+		return false;
+	}
+	size = st.st_size;
+	void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED) {
+		cout << "Cache snapshot: cannot map " << filename << endl;
+		data = NULL;
+		close();
+		return false;
+	}
+	data = (char*)p;
+
+	// header
+	if(memcmp(data, SNAPSHOT_MAGIC, 8) != 0) {
+		cout << "Cache snapshot: " << filename << " is not a snapshot" << endl;
+		close();
+		return false;
+	}
+	uint32_t numnodes = *(uint32_t*)(data + 8);
+	uint32_t keylen = *(uint32_t*)(data + 12);
+	size_t table = align(16 + keylen);
+	if(16 + keylen > size || table + (size_t)numnodes * sizeof(SnapshotEntry) > size ||
+	   key.compare(0, string::npos, data + 16, keylen) != 0) {
+		cout << "Cache snapshot: " << filename << " is of another dataset" << endl;
+		close();
+		return false;
+	}
+
+	const SnapshotEntry* e = (const SnapshotEntry*)(data + table);
+	for(int i=0; i < numnodes; i++, e++) {
+		size_t bytes = (size_t)e->numpoints * (3 * sizeof(float) + (e->hascolors ? 3 : 0));
+		if(e->name[SNAPSHOT_NAME_SIZE-1] != 0 || e->offset + bytes > size) {
+			cout << "Cache snapshot: " << filename << " is truncated" << endl;
+			close();
+			return false;
+		}
+		entries[e->name] = e;
+		names.push_back(e->name);
+	}
+	cout << "Cache snapshot: " << names.size() << " nodes, " << size / 1024 / 1024 << " MB from " << filename << endl;
+	return true;
+}
+
+void CacheSnapshot::close() {
+	entries.clear();
+	names.clear();
+	if(data)
+		munmap(data, size);
+	data = NULL;
+	size = 0;
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+}
+
+bool CacheSnapshot::restore(const string& name, vector<float>& vertices, vector<unsigned char>& colors) {
+	map<string, const SnapshotEntry*>::const_iterator it = entries.find(name);
+	if(it == entries.end())
+		return false;
+	const SnapshotEntry* e = it->second;
+	const float* v = (const float*)(data + e->offset);
+	vertices.assign(v, v + 3 * e->numpoints);
+	if(e->hascolors) {
+		const unsigned char* c = (const unsigned char*)(v + 3 * e->numpoints);
+		colors.assign(c, c + 3 * e->numpoints);
+	}
+	pthread_mutex_lock(&mutex);
+	numRestored++;
+	pthread_mutex_unlock(&mutex);
+	return true;
+}
+
+// written to a temporary file that replaces the snapshot, a mapped older one stays valid
+bool CacheSnapshot::save(const string& filename, const string& key, const vector<NodeGeometry*>& nodes,
+						 double maxbytes) {
+	vector<SnapshotEntry> table;
+	vector<NodeGeometry*> saved;
+	double bytes = 0;
+	for(int i=0; i < nodes.size(); i++) {
+		NodeGeometry* node = nodes[i];
+		const vector<float>& vertices = node->getVertices();
+		if(!node->isLoaded() || vertices.empty() || node->getName().size() >= SNAPSHOT_NAME_SIZE)
+			continue;
+		SnapshotEntry e;
+		memset(&e, 0, sizeof(e));
+		strncpy(e.name, node->getName().c_str(), SNAPSHOT_NAME_SIZE - 1);
+		e.numpoints = vertices.size() / 3;
+		e.hascolors = node->getColors().size() == vertices.size();
+		double nodebytes = e.numpoints * (3 * sizeof(float) + (e.hascolors ? 3 : 0));
+		if(bytes + nodebytes > maxbytes)
+			break;
+		bytes += nodebytes;
+		table.push_back(e);
+		saved.push_back(node);
+	}
+
+	size_t offset = align(align(16 + key.size()) + table.size() * sizeof(SnapshotEntry));
+	for(int i=0; i < table.size(); i++) {
+		table[i].offset = offset;
+		offset = align(offset + (size_t)table[i].numpoints * (3 * sizeof(float) + (table[i].hascolors ? 3 : 0)));
+	}
+
+	// display nodes sharing a config may write the same snapshot, each through its own file
+	char host[256] = {0};
+	gethostname(host, sizeof(host) - 1);
+	stringstream tmpname;
+	tmpname << filename << "." << host << "." << getpid() << ".tmp";
+	string tmp = tmpname.str();
+	ofstream out(tmp.c_str(), ios::out | ios::binary);
+	if(!out.is_open()) {
+		cout << "Cache snapshot: cannot write " << tmp << endl;
+		return false;
+	}
+	const char zeros[SNAPSHOT_ALIGN] = {0};
+	uint32_t numnodes = table.size();
+	uint32_t keylen = key.size();
+	out.write(SNAPSHOT_MAGIC, 8);
+	out.write((const char*)&numnodes, 4);
+	out.write((const char*)&keylen, 4);
+	out.write(key.data(), keylen);
+	out.write(zeros, align(16 + keylen) - (16 + keylen));
+	if(numnodes > 0)
+		out.write((const char*)&table[0], table.size() * sizeof(SnapshotEntry));
+	for(int i=0; i < saved.size(); i++) {
+		size_t pos = out.tellp();
+		out.write(zeros, table[i].offset - pos);
+		const vector<float>& vertices = saved[i]->getVertices();
+		out.write((const char*)&vertices[0], vertices.size() * sizeof(float));
+		if(table[i].hascolors)
+			out.write((const char*)&saved[i]->getColors()[0], saved[i]->getColors().size());
+	}
+	out.close();
+	if(out.fail() || rename(tmp.c_str(), filename.c_str()) != 0) {
+		cout << "Cache snapshot: cannot write " << filename << endl;
+		return false;
+	}
+	cout << "Cache snapshot: saved " << numnodes << " nodes, " << bytes / 1024 / 1024 << " MB to " << filename << endl;
+	return true;
+}
+
+void CacheSnapshot::printInfo() {
+	pthread_mutex_lock(&mutex);
+	int restored = numRestored;
+	pthread_mutex_unlock(&mutex);
+	cout << "cache snapshot: " << filename << " nodes: " << names.size() << " restored: " << restored << endl;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,68 @@
+#ifndef _CACHE_SNAPSHOT_H_
+#define _CACHE_SNAPSHOT_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace gigapoint {
+
+class NodeGeometry;
+
+#define SNAPSHOT_MAGIC "GPSNAP1"
+#define SNAPSHOT_NAME_SIZE 32	// node names are at most 31 characters
+
+struct SnapshotEntry {
+	char name[SNAPSHOT_NAME_SIZE];
+	uint32_t numpoints;
+	uint32_t hascolors;
+	uint64_t offset;	// vertices, followed by the colors
+};
+
+// Decoded node data in a single local file, written on shutdown or on demand
+// and mapped on the next start, so nodes are restored with a copy instead of
+// reading and decoding their .bin files from the shared filesystem. A key of
+// the dataset is stored with it and a snapshot of another dataset is ignored.
+// Layout: magic, number of nodes, key length and key, a table of
+// SnapshotEntry, then the data of the nodes as they are stored in the buffer
+// pool (3 floats per vertex, 3 bytes per color). Native byte order.
+// restore can be called by the loader threads.
+class CacheSnapshot {
+
+private:
+	std::string filename;
+	int fd;
+	char* data;
+	size_t size;
+	std::map<std::string, const SnapshotEntry*> entries;
+	std::vector<std::string> names;	// in file order
+
+	pthread_mutex_t mutex;
+	int numRestored;
+
+public:
+	CacheSnapshot(const std::string& filename);
+	~CacheSnapshot();
+
+	// maps the file, false if it is missing, broken or of another dataset
+	bool open(const std::string& key);
+	void close();
+
+	// copies the data of the node, false if the snapshot does not hold it
+	bool restore(const std::string& name, std::vector<float>& vertices, std::vector<unsigned char>& colors);
+	// nodes in the order they were saved
+	const std::vector<std::string>& getNames() { return names; }
+	int getNumNodes() { return names.size(); }
+
+	// writes the loaded nodes, in order, up to maxbytes of data
+	static bool save(const std::string& filename, const std::string& key, const std::vector<NodeGeometry*>& nodes,
+					 double maxbytes);
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
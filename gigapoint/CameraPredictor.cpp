@@ -0,0 +1,157 @@
+#include "CameraPredictor.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <math.h>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define PREDICTOR_WINDOW 250		// ms of samples the motion is taken over
+#define PREDICTOR_MIN_INTERVAL 20	// ms, shorter intervals are too noisy
+#define PREDICTOR_MAX_STEPS 8		// rotation intervals applied at most
+#define PREDICTOR_MIN_MOTION 0.0001f
+
+// column major 4x4
+static void multiply(const float a[16], const float b[16], float out[16]) {
+	float r[16];
+	for(int c=0; c < 4; c++)
+		for(int i=0; i < 4; i++)
+			r[c*4 + i] = a[i]*b[c*4] + a[4+i]*b[c*4+1] + a[8+i]*b[c*4+2] + a[12+i]*b[c*4+3];
+	for(int i=0; i < 16; i++)
+		out[i] = r[i];
+}
+
+static bool invert(const float m[16], float out[16]) {
+	float inv[16];
+	inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+	inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+	inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+	inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+	inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+	inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+	inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+	inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+	inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+	inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+	inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+	inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+	inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+	inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+	inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+	inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+	float det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+	if(det == 0)
+		return false;
+	for(int i=0; i < 16; i++)
+		out[i] = inv[i] / det;
+	return true;
+}
+
+// MVP * translate(campos): the view projection of a camera at the origin
+static void removeTranslation(const float MVP[16], const float campos[3], float out[16]) {
+	for(int i=0; i < 12; i++)
+		out[i] = MVP[i];
+	for(int i=0; i < 4; i++)
+		out[12+i] = MVP[i]*campos[0] + MVP[4+i]*campos[1] + MVP[8+i]*campos[2] + MVP[12+i];
+}
+
+CameraPredictor::CameraPredictor(): numSamples(0), last(-1), numPredictions(0), speed(0), angularSpeed(0) {
+}
+
+CameraPredictor::~CameraPredictor() {
+}
+
+void CameraPredictor::frame(const float MVP[16], const float campos[3]) {
+	last = (last + 1) % PREDICTOR_SAMPLES;
+	Sample& s = samples[last];
+	s.time = Utils::getTimeUs();
+	for(int i=0; i < 16; i++)
+		s.MVP[i] = MVP[i];
+	for(int i=0; i < 3; i++)
+		s.campos[i] = campos[i];
+	if(numSamples < PREDICTOR_SAMPLES)
+		numSamples++;
+}
+
+bool CameraPredictor::predict(unsigned int ahead, float MVP[16], float campos[3]) {
+	if(numSamples < 2)
+		return false;
+	const Sample& now = samples[last];
+
+	// the oldest sample within the window
+	const Sample* ref = NULL;
+	for(int k=1; k < numSamples; k++) {
+		const Sample& s = samples[(last - k + PREDICTOR_SAMPLES) % PREDICTOR_SAMPLES];
+		if(now.time - s.time > PREDICTOR_WINDOW * 1000)
+			break;
+		ref = &s;
+	}
+	if(!ref)
+		return false;
+	float dt = (now.time - ref->time) / 1000.0f;
+	if(dt < PREDICTOR_MIN_INTERVAL)
+		return false;
+
+	float velocity[3];
+	float dist = 0;
+	for(int i=0; i < 3; i++) {
+		velocity[i] = (now.campos[i] - ref->campos[i]) / dt;
+		dist += velocity[i] * velocity[i];
+	}
+	speed = sqrt(dist) * 1000;
+
+	// D = R_now R_ref^-1 in clip space, applied once per interval of dt
+	float rnow[16], rref[16], rinv[16], delta[16];
+	removeTranslation(now.MVP, now.campos, rnow);
+	removeTranslation(ref->MVP, ref->campos, rref);
+	if(!invert(rref, rinv))
+		return false;
+	multiply(rnow, rinv, delta);
+	float change = 0;
+	for(int i=0; i < 16; i++)
+		change += fabs(delta[i] - (i % 5 == 0 ? 1 : 0));
+	// the trace is kept by the projection, 2 + 2 cos(angle) for a rotation
+	float c = (delta[0] + delta[5] + delta[10] + delta[15] - 2) * 0.5f;
+	angularSpeed = acos(c > 1 ? 1 : (c < -1 ? -1 : c)) * 180 / PI / dt * 1000;
+
+	if(speed * ahead / 1000 < PREDICTOR_MIN_MOTION && change < PREDICTOR_MIN_MOTION)
+		return false;
+
+	float steps = ahead / dt;
+	if(steps > PREDICTOR_MAX_STEPS)
+		steps = PREDICTOR_MAX_STEPS;
+	float rotation[16];
+	for(int i=0; i < 16; i++)
+		rotation[i] = rnow[i];
+	int n = (int)steps;
+	for(int k=0; k < n; k++)
+		multiply(delta, rotation, rotation);
+	// the remaining fraction of an interval linearly
+	float f = steps - n;
+	if(f > 0) {
+		float partial[16];
+		for(int i=0; i < 16; i++)
+			partial[i] = (i % 5 == 0 ? 1 : 0) + f * (delta[i] - (i % 5 == 0 ? 1 : 0));
+		multiply(partial, rotation, rotation);
+	}
+
+	for(int i=0; i < 3; i++)
+		campos[i] = now.campos[i] + velocity[i] * ahead;
+	// translate(-campos)
+	for(int i=0; i < 12; i++)
+		MVP[i] = rotation[i];
+	for(int i=0; i < 4; i++)
+		MVP[12+i] = rotation[12+i] - rotation[i]*campos[0] - rotation[4+i]*campos[1] - rotation[8+i]*campos[2];
+	numPredictions++;
+	return true;
+}
+
+void CameraPredictor::printInfo() {
+	cout << "camera predictor: predictions: " << numPredictions << " speed: " << speed << "/s angular: "
+		 << angularSpeed << " deg/s" << endl;
+}
+
+}; //namespace gigapoint
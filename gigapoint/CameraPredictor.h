@@ -0,0 +1,47 @@
+#ifndef _CAMERA_PREDICTOR_H_
+#define _CAMERA_PREDICTOR_H_
+
+namespace gigapoint {
+
+#define PREDICTOR_SAMPLES 16
+
+// Extrapolates the camera from its recent positions and view projection
+// matrices. The velocity is taken over the samples of the last
+// PREDICTOR_WINDOW ms, the rotation (and zoom) over the same interval is the
+// change of the view projection with the camera translation removed, and it
+// is applied again for every such interval of the lookahead. Render thread only.
+class CameraPredictor {
+
+private:
+	struct Sample {
+		unsigned long time;		// us
+		float MVP[16];
+		float campos[3];
+	};
+
+	Sample samples[PREDICTOR_SAMPLES];	// ring buffer
+	int numSamples;
+	int last;
+
+	// stats
+	int numPredictions;
+	float speed;			// units per second of the last prediction
+	float angularSpeed;		// degrees per second of the last prediction
+
+public:
+	CameraPredictor();
+	~CameraPredictor();
+
+	// called once per frame with the current camera
+	void frame(const float MVP[16], const float campos[3]);
+	void reset() { numSamples = 0; }
+
+	// view projection and position ahead ms from the last sample, false while the camera does not move
+	bool predict(unsigned int ahead, float MVP[16], float campos[3]);
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
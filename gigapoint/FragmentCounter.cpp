@@ -0,0 +1,87 @@
+#include "FragmentCounter.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace gigapoint {
+
+FragmentCounter::FragmentCounter(int numviews): numViews(numviews), queries(numviews * FRAGMENT_NUM_PASSES, 0),
+												pending(numviews * FRAGMENT_NUM_PASSES, false),
+												issued(numviews * FRAGMENT_NUM_PASSES, false),
+												fragments(numviews * FRAGMENT_NUM_PASSES, 0), active(-1), initialized(false) {
+}
+
+FragmentCounter::~FragmentCounter() {
+}
+
+void FragmentCounter::init() {
+	initialized = true;
+	glGenQueries(queries.size(), &queries[0]);
+}
+
+void FragmentCounter::update() {
+	if(!initialized)
+		init();
+
+	for(int i=0; i < queries.size(); i++) {
+		if(pending[i]) {
+			GLint available = 0;
+			glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if(available) {
+				GLuint samples = 0;
+				glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+				fragments[i] = fragments[i] == 0 ? samples : 0.9 * fragments[i] + 0.1 * samples;
+				pending[i] = false;
+			}
+		}
+		else if(!issued[i]) {
+			// view or pass was not drawn last frame
+			fragments[i] = 0;
+		}
+		issued[i] = false;
+	}
+}
+
+void FragmentCounter::begin(int view, int pass) {
+	if(view < 0 || view >= numViews)
+		return;
+	int i = view * FRAGMENT_NUM_PASSES + pass;
+	issued[i] = true;
+	if(pending[i] || active >= 0)
+		return;
+	glBeginQuery(GL_SAMPLES_PASSED, queries[i]);
+	active = i;
+}
+
+void FragmentCounter::end() {
+	if(active < 0)
+		return;
+	glEndQuery(GL_SAMPLES_PASSED);
+	pending[active] = true;
+	active = -1;
+}
+
+void FragmentCounter::destroy() {
+	if(initialized)
+		glDeleteQueries(queries.size(), &queries[0]);
+	initialized = false;
+}
+
+float FragmentCounter::getFragments(int pass) {
+	float sum = 0;
+	for(int v=0; v < numViews; v++)
+		sum += fragments[v * FRAGMENT_NUM_PASSES + pass];
+	return sum;
+}
+
+void FragmentCounter::printInfo(bool prepass) {
+	cout << "fragments: " << (long)getFragments(FRAGMENT_PASS_COLOR) << " shaded/frame";
+	if(prepass)
+		cout << " (depth prepass on, " << (long)getFragments(FRAGMENT_PASS_DEPTH) << " in prepass)";
+	else
+		cout << " (depth prepass off)";
+	cout << endl;
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,54 @@
+#ifndef _FRAGMENT_COUNTER_H_
+#define _FRAGMENT_COUNTER_H_
+
+#ifdef STANDALONE_APP
+#include "app/GLInclude.h"
+#else
+#include <omegaGl.h>
+#endif
+
+#include <vector>
+
+namespace gigapoint {
+
+#define FRAGMENT_PASS_COLOR 0
+#define FRAGMENT_PASS_DEPTH 1
+#define FRAGMENT_NUM_PASSES 2
+
+// Counts fragments that pass the depth test with GL_SAMPLES_PASSED queries,
+// one per view and pass, and sums the views of a frame. Results are read back
+// a frame later when they are available so the render thread never waits for
+// the GPU. Render thread only.
+class FragmentCounter {
+
+private:
+	int numViews;
+	// per view and pass, at view * FRAGMENT_NUM_PASSES + pass
+	std::vector<unsigned int> queries;
+	std::vector<bool> pending;
+	std::vector<bool> issued;		// query started this frame
+	std::vector<float> fragments;	// smoothed fragments per frame
+	int active;
+	bool initialized;
+
+	void init();
+
+public:
+	FragmentCounter(int numviews);
+	~FragmentCounter();
+
+	// read back finished queries, once per frame before the first begin
+	void update();
+	// a query is only started when the previous result of the view and pass has been read
+	void begin(int view, int pass);
+	void end();
+	void destroy();
+
+	// of all views drawn in a frame
+	float getFragments(int pass);
+	void printInfo(bool prepass);
+};
+
+}; //namespace gigapoint
+
+#endif
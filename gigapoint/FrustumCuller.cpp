@@ -0,0 +1,98 @@
+#include "FrustumCuller.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace gigapoint {
+
+ChildBounds::ChildBounds() {
+	for(int i=0; i < 8; i++)
+		minx[i] = miny[i] = minz[i] = maxx[i] = maxy[i] = maxz[i] = 0;
+}
+
+void ChildBounds::set(int i, const float bbox[6]) {
+	minx[i] = bbox[0]; miny[i] = bbox[1]; minz[i] = bbox[2];
+	maxx[i] = bbox[3]; maxy[i] = bbox[4]; maxz[i] = bbox[5];
+}
+
+// a box is outside a plane when its p-vertex (the corner furthest along the
+// normal) is not in front of it and inside when its n-vertex is
+int FrustumCuller::testBox(float V[6][4], const float b[6], int planemask) {
+	for(int p=0; p < 6; p++) {
+		if(!(planemask & (1 << p)))
+			continue;
+		const float* n = V[p];
+		float dp = n[0] * (n[0] > 0 ? b[3] : b[0]) + n[1] * (n[1] > 0 ? b[4] : b[1]) +
+				   n[2] * (n[2] > 0 ? b[5] : b[2]) + n[3];
+		if(dp <= 0)
+			return FRUSTUM_OUTSIDE;
+		float dn = n[0] * (n[0] > 0 ? b[0] : b[3]) + n[1] * (n[1] > 0 ? b[1] : b[4]) +
+				   n[2] * (n[2] > 0 ? b[2] : b[5]) + n[3];
+		if(dn > 0)
+			planemask &= ~(1 << p);
+	}
+	return planemask;
+}
+
+void FrustumCuller::testChildren(float V[6][4], const ChildBounds& bounds, int planemask, int masks[8]) {
+	int outside = 0;		// bit per child
+	int inside[6];			// per plane, bit per child
+	for(int p=0; p < 6; p++) {
+		inside[p] = 0;
+		if(!(planemask & (1 << p)))
+			continue;
+		const float* n = V[p];
+		// the p-vertex and n-vertex pick the same corner for every child
+		const float* px = n[0] > 0 ? bounds.maxx : bounds.minx;
+		const float* py = n[1] > 0 ? bounds.maxy : bounds.miny;
+		const float* pz = n[2] > 0 ? bounds.maxz : bounds.minz;
+		const float* nx = n[0] > 0 ? bounds.minx : bounds.maxx;
+		const float* ny = n[1] > 0 ? bounds.miny : bounds.maxy;
+		const float* nz = n[2] > 0 ? bounds.minz : bounds.maxz;
+#if defined(__AVX__)
+		__m256 a = _mm256_set1_ps(n[0]), b = _mm256_set1_ps(n[1]), c = _mm256_set1_ps(n[2]), d = _mm256_set1_ps(n[3]);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 dp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(px)), _mm256_mul_ps(b, _mm256_loadu_ps(py))),
+								  _mm256_add_ps(_mm256_mul_ps(c, _mm256_loadu_ps(pz)), d));
+		__m256 dn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(nx)), _mm256_mul_ps(b, _mm256_loadu_ps(ny))),
+								  _mm256_add_ps(_mm256_mul_ps(c, _mm256_loadu_ps(nz)), d));
+		outside |= _mm256_movemask_ps(_mm256_cmp_ps(dp, zero, _CMP_LE_OQ));
+		inside[p] = _mm256_movemask_ps(_mm256_cmp_ps(dn, zero, _CMP_GT_OQ));
+#elif defined(__SSE__)
+		__m128 a = _mm_set1_ps(n[0]), b = _mm_set1_ps(n[1]), c = _mm_set1_ps(n[2]), d = _mm_set1_ps(n[3]);
+		__m128 zero = _mm_setzero_ps();
+		for(int h=0; h < 8; h += 4) {
+			__m128 dp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(px+h)), _mm_mul_ps(b, _mm_loadu_ps(py+h))),
+								   _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(pz+h)), d));
+			__m128 dn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(nx+h)), _mm_mul_ps(b, _mm_loadu_ps(ny+h))),
+								   _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(nz+h)), d));
+			outside |= _mm_movemask_ps(_mm_cmple_ps(dp, zero)) << h;
+			inside[p] |= _mm_movemask_ps(_mm_cmpgt_ps(dn, zero)) << h;
+		}
+#else
+		for(int i=0; i < 8; i++) {
+			if(n[0]*px[i] + n[1]*py[i] + n[2]*pz[i] + n[3] <= 0)
+				outside |= 1 << i;
+			if(n[0]*nx[i] + n[1]*ny[i] + n[2]*nz[i] + n[3] > 0)
+				inside[p] |= 1 << i;
+		}
+#endif
+	}
+
+	for(int i=0; i < 8; i++) {
+		if(outside & (1 << i)) {
+			masks[i] = FRUSTUM_OUTSIDE;
+			continue;
+		}
+		masks[i] = planemask;
+		for(int p=0; p < 6; p++) {
+			if(inside[p] & (1 << i))
+				masks[i] &= ~(1 << p);
+		}
+	}
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,38 @@
+#ifndef _FRUSTUM_CULLER_H_
+#define _FRUSTUM_CULLER_H_
+
+namespace gigapoint {
+
+#define FRUSTUM_ALL_PLANES 0x3F
+#define FRUSTUM_OUTSIDE -1
+
+// bounding boxes of the 8 children of a node in structure of arrays form,
+// lane i holds the child with index i
+struct ChildBounds {
+	float minx[8];
+	float miny[8];
+	float minz[8];
+	float maxx[8];
+	float maxy[8];
+	float maxz[8];
+
+	ChildBounds();
+	void set(int i, const float bbox[6]);
+};
+
+// Frustum culling with the p-vertex/n-vertex test against planes from
+// Utils::getFrustum. Results are masks of the planes a box still
+// intersects: children only test those planes, and a mask of 0 means the
+// whole subtree is inside and needs no more tests.
+class FrustumCuller {
+
+public:
+	// mask of intersected planes of one box, FRUSTUM_OUTSIDE when culled
+	static int testBox(float V[6][4], const float b[6], int planemask = FRUSTUM_ALL_PLANES);
+	// the same for all 8 children of a node at once (SSE or AVX when available)
+	static void testChildren(float V[6][4], const ChildBounds& bounds, int planemask, int masks[8]);
+};
+
+}; //namespace gigapoint
+
+#endif
@@ -5,8 +5,21 @@ namespace gigapoint {
 size_t LRUCache::prune() {
     if (m_maxSize > 0 && m_cache.size() >= (m_maxSize + m_elasticity)) {
         size_t count = 0;
-        while (m_cache.size() > m_maxSize) {
+        size_t skipped = 0;
+        while (m_cache.size() > m_maxSize && m_keys.head && skipped < m_keys.size) {
             Node* n = m_keys.pop();
+            // queued and loading nodes have no data to free yet, evicting them would leave the data
+            // they load outside the cache. They go back as the most recently used.
+            if (n->value->inQueue() || n->value->isLoading()) {
+                m_keys.push(n);
+                skipped++;
+                continue;
+            }
+            m_numEvicted++;
+            if (n->value->isLoaded() && !n->value->wasDrawn())
+                m_numEvictedUndrawn++;
+            if (n->value->isPrefetched())
+                m_numEvictedPrefetched++;
             n->value->freeData();
             m_cache.erase(n->key);
             delete n;
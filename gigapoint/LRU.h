@@ -23,8 +23,9 @@ struct Node {
 	Node* next;
 	string key;
 	NodeGeometry* value;
+	bool pinned;	// not in the eviction list while the node is visible
 
-	Node(const string& keyObj, NodeGeometry* valueObj): prev(0), next(0), key(keyObj) {
+	Node(const string& keyObj, NodeGeometry* valueObj): prev(0), next(0), key(keyObj), pinned(false) {
 		value = valueObj;
 	}
 
@@ -142,23 +143,28 @@ public:
 
 	// -- methods
 	LRUCache(size_t maxSize = 64, size_t elasticity = 10) :
-			m_maxSize(maxSize), m_elasticity(elasticity) {
+			m_maxSize(maxSize), m_elasticity(elasticity), m_numPinned(0), m_numEvicted(0), m_numEvictedUndrawn(0), m_numEvictedPrefetched(0) {
 	}
 
 	virtual ~LRUCache() {
 	}
 
 	void clear() {
+		// pinned nodes are not linked in the key list
+		for (MapType::iterator iter = m_cache.begin(); iter != m_cache.end(); iter++) {
+			if (iter->second->pinned)
+				delete iter->second;
+		}
 		m_cache.clear();
 		m_keys.clear();
+		m_numPinned = 0;
 	}
 
 	void insert(const string& key, NodeGeometry* value) {
 		MapType::iterator iter = m_cache.find(key);
 		if (iter != m_cache.end()) {
 			iter->second->value = value;
-			m_keys.remove(iter->second);
-			m_keys.push(iter->second);
+			touch(iter->second);
 		} else {
 			Node* n = new Node(key, value);
 			m_cache[key] = n;
@@ -173,8 +179,7 @@ public:
 		if (iter == m_cache.end()) {
 			return false;
 		} else {
-			m_keys.remove(iter->second);
-			m_keys.push(iter->second);
+			touch(iter->second);
 			value = iter->second->value;
 			return true;
 		}
@@ -186,8 +191,7 @@ public:
 		if (iter == m_cache.end()) {
 			throw KeyNotFound();
 		}
-		m_keys.remove(iter->second);
-		m_keys.push(iter->second);
+		touch(iter->second);
 		return iter->second->value;
 
 	}
@@ -195,11 +199,48 @@ public:
 	void remove(const string& key) {
 		MapType::iterator iter = m_cache.find(key);
 		if (iter != m_cache.end()) {
-			m_keys.remove(iter->second);
+			if (iter->second->pinned)
+				m_numPinned--;
+			else
+				m_keys.remove(iter->second);
 			m_cache.erase(iter);
 		}
 	}
 
+	// visible nodes are pinned so they cannot be evicted while they are not touched
+	void pin(const string& key, NodeGeometry* value) {
+		MapType::iterator iter = m_cache.find(key);
+		if (iter == m_cache.end()) {
+			Node* n = new Node(key, value);
+			n->pinned = true;
+			m_cache[key] = n;
+			m_numPinned++;
+			prune();
+		} else if (!iter->second->pinned) {
+			iter->second->value = value;
+			m_keys.remove(iter->second);
+			iter->second->pinned = true;
+			m_numPinned++;
+		}
+	}
+
+	// back into the eviction list as the most recently used
+	void unpin(const string& key) {
+		MapType::iterator iter = m_cache.find(key);
+		if (iter == m_cache.end() || !iter->second->pinned)
+			return;
+		iter->second->pinned = false;
+		m_numPinned--;
+		m_keys.push(iter->second);
+		prune();
+	}
+
+	// all cached nodes, pinned or not
+	void getValues(std::vector<NodeGeometry*>& values) {
+		for (MapType::iterator iter = m_cache.begin(); iter != m_cache.end(); iter++)
+			values.push_back(iter->second->value);
+	}
+
 	bool contains(const string& key) {
 		return m_cache.find(key) != m_cache.end();
 	}
@@ -217,6 +258,24 @@ public:
 		return m_cache.size();
 	}
 
+	int numPinned() {
+		return m_numPinned;
+	}
+
+	// evicted nodes, and those of them that were loaded but never drawn
+	int numEvicted() {
+		return m_numEvicted;
+	}
+
+	int numEvictedUndrawn() {
+		return m_numEvictedUndrawn;
+	}
+
+	// prefetched nodes evicted before they became visible
+	int numEvictedPrefetched() {
+		return m_numEvictedPrefetched;
+	}
+
 	void dumpDebug(std::ostream& os) const {
 		std::cout << "LRUCache Size : " << m_cache.size() << " (max:" << m_maxSize
 				<< ") (elasticity: " << m_elasticity << ")" << std::endl;
@@ -228,11 +287,22 @@ public:
 protected:
     size_t prune();
 
+	void touch(Node* node) {
+		if (node->pinned)
+			return;
+		m_keys.remove(node);
+		m_keys.push(node);
+	}
+
 private:
 	MapType m_cache;
 	List m_keys;
 	size_t m_maxSize;
 	size_t m_elasticity;
+	size_t m_numPinned;
+	int m_numEvicted;
+	int m_numEvictedUndrawn;
+	int m_numEvictedPrefetched;
 
 private:
 	LRUCache(const LRUCache&);
@@ -0,0 +1,109 @@
+#include "LoadErrorCache.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace gigapoint {
+
+LoadErrorCache::LoadErrorCache(unsigned int mindelay, unsigned int maxdelay): minDelay(mindelay), maxDelay(maxdelay),
+																			  numRecovered(0) {
+	pthread_mutex_init(&mutex, NULL);
+	for(int i=0; i <= LOAD_ERROR_HIERARCHY; i++)
+		numFailures[i] = 0;
+	if(maxDelay < minDelay)
+		maxDelay = minDelay;
+}
+
+LoadErrorCache::~LoadErrorCache() {
+	pthread_mutex_destroy(&mutex);
+}
+
+unsigned int LoadErrorCache::reportFailure(const string& file, int error) {
+	pthread_mutex_lock(&mutex);
+	LoadErrorEntry& entry = entries[file];
+	entry.error = error;
+	entry.count++;
+	numFailures[error]++;
+
+	unsigned int delay = 0;
+	bool saturated = false;
+	if(error != LOAD_ERROR_TRUNCATED) {
+		delay = (entry.delay == 0) ? minDelay : entry.delay * 2;
+		if(delay >= maxDelay) {
+			saturated = entry.delay < maxDelay;
+			delay = maxDelay;
+		}
+		entry.delay = delay;
+	}
+	int count = entry.count;
+	pthread_mutex_unlock(&mutex);
+
+	// only report the first failure and when the backoff saturates
+	if(count == 1 || saturated)
+		cout << "Load error (" << errorName(error) << "): " << file << " failures: " << count
+			 << " retry in " << delay << " ms" << endl;
+
+	return delay;
+}
+
+void LoadErrorCache::reportSuccess(const string& file) {
+	pthread_mutex_lock(&mutex);
+	map<string, LoadErrorEntry>::iterator it = entries.find(file);
+	if(it != entries.end() && it->second.error != LOAD_ERROR_TRUNCATED) {
+		entries.erase(it);
+		numRecovered++;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+int LoadErrorCache::size() {
+	pthread_mutex_lock(&mutex);
+	int s = entries.size();
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+void LoadErrorCache::clear() {
+	pthread_mutex_lock(&mutex);
+	entries.clear();
+	for(int i=0; i <= LOAD_ERROR_HIERARCHY; i++)
+		numFailures[i] = 0;
+	numRecovered = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+static bool compareErrorCount(const pair<string, LoadErrorEntry>& a, const pair<string, LoadErrorEntry>& b) {
+	return a.second.count > b.second.count;
+}
+
+void LoadErrorCache::printSummary(int maxfiles) {
+	pthread_mutex_lock(&mutex);
+	cout << "==== Load errors ====" << endl;
+	cout << "files: " << entries.size() << " recovered: " << numRecovered << endl;
+	for(int i=LOAD_ERROR_MISSING; i <= LOAD_ERROR_HIERARCHY; i++)
+		cout << errorName(i) << ": " << numFailures[i] << " ";
+	cout << endl;
+
+	vector<pair<string, LoadErrorEntry> > sorted(entries.begin(), entries.end());
+	sort(sorted.begin(), sorted.end(), compareErrorCount);
+	for(int i=0; i < sorted.size() && i < maxfiles; i++) {
+		cout << sorted[i].first << " " << errorName(sorted[i].second.error) << " failures: " << sorted[i].second.count
+			 << " backoff: " << sorted[i].second.delay << " ms" << endl;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+const char* LoadErrorCache::errorName(int error) {
+	switch(error) {
+		case LOAD_ERROR_MISSING: return "missing";
+		case LOAD_ERROR_EMPTY: return "empty";
+		case LOAD_ERROR_TRUNCATED: return "truncated";
+		case LOAD_ERROR_HIERARCHY: return "hierarchy";
+		default: return "none";
+	}
+}
+
+}; //namespace gigapoint
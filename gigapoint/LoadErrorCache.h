@@ -0,0 +1,58 @@
+#ifndef _LOAD_ERROR_CACHE_H_
+#define _LOAD_ERROR_CACHE_H_
+
+#include <pthread.h>
+#include <string>
+#include <map>
+
+namespace gigapoint {
+
+enum LoadError {
+	LOAD_ERROR_NONE = 0,
+	LOAD_ERROR_MISSING,		// .bin cannot be opened
+	LOAD_ERROR_EMPTY,		// .bin has no points
+	LOAD_ERROR_TRUNCATED,	// .bin size is not a multiple of the point size
+	LOAD_ERROR_HIERARCHY	// .hrc cannot be opened or is empty
+};
+
+struct LoadErrorEntry {
+	int error;				// last LoadError
+	int count;				// number of failures
+	unsigned int delay;		// current backoff (ms)
+
+	LoadErrorEntry(): error(LOAD_ERROR_NONE), count(0), delay(0) {}
+};
+
+// Negative cache of node files that failed to load.
+// Every failure of the same file doubles its retry delay, up to maxDelay.
+// Nodes keep their own failure time and delay, the cache keeps the policy
+// and the per file counters for the summary report.
+class LoadErrorCache {
+
+private:
+	pthread_mutex_t mutex;
+	std::map<std::string, LoadErrorEntry> entries;
+	unsigned int minDelay;
+	unsigned int maxDelay;
+	int numFailures[LOAD_ERROR_HIERARCHY+1];
+	int numRecovered;
+
+public:
+	LoadErrorCache(unsigned int mindelay = 1000, unsigned int maxdelay = 60000);
+	~LoadErrorCache();
+
+	// returns the delay (ms) before the file may be tried again.
+	// LOAD_ERROR_TRUNCATED is only recorded and returns 0
+	unsigned int reportFailure(const std::string& file, int error);
+	void reportSuccess(const std::string& file);
+
+	int size();
+	void clear();
+	void printSummary(int maxfiles = 10);
+
+	static const char* errorName(int error);
+};
+
+}; //namespace gigapoint
+
+#endif
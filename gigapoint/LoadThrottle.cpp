@@ -0,0 +1,121 @@
+#include "LoadThrottle.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <math.h>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define THROTTLE_SMOOTH 0.1f		// weight of the newest frame in the average
+#define THROTTLE_TOLERANCE 0.1f		// dead band around the target
+#define THROTTLE_DECREASE 0.7f		// multiplicative decrease when over target
+#define THROTTLE_INCREASE 0.05f		// additive increase when under target
+#define THROTTLE_IDLE_INCREASE 0.25f	// additive increase when the camera is idle
+#define THROTTLE_MIN_LEVEL 0.05f
+
+LoadThrottle::LoadThrottle(int maxloads, int maxuploads, float targetframetime, unsigned int idletime):
+							targetFrameTime(targetframetime), idleTime(idletime), maxLoads(maxloads),
+							maxUploads(maxuploads), level(1), frameTime(0), activeLoads(0), loadedPoints(0), loadTime(0), busyStart(0) {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&condv, NULL);
+	if(maxLoads < 1)
+		maxLoads = 1;
+	lastMoveTime = Utils::getTime();
+	updateLimits();
+}
+
+LoadThrottle::~LoadThrottle() {
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&condv);
+}
+
+void LoadThrottle::updateLimits() {
+	loadLimit = (int)ceil(level * maxLoads);
+	if(loadLimit < 1)
+		loadLimit = 1;
+	uploadLimit = 0;
+	if(maxUploads > 0) {
+		uploadLimit = (int)ceil(level * maxUploads);
+		if(uploadLimit < 1)
+			uploadLimit = 1;
+	}
+}
+
+void LoadThrottle::frame(float frametime, bool cameramoved) {
+	unsigned int now = Utils::getTime();
+	if(cameramoved)
+		lastMoveTime = now;
+
+	pthread_mutex_lock(&mutex);
+	if(frameTime == 0)
+		frameTime = frametime;
+	else
+		frameTime = (1 - THROTTLE_SMOOTH) * frameTime + THROTTLE_SMOOTH * frametime;
+
+	if(targetFrameTime <= 0 || now - lastMoveTime >= idleTime) {
+		// disabled or idle camera: fill in detail at full throughput
+		level += THROTTLE_IDLE_INCREASE;
+	}
+	else if(frameTime > targetFrameTime * (1 + THROTTLE_TOLERANCE)) {
+		level *= THROTTLE_DECREASE;
+	}
+	else if(frameTime < targetFrameTime * (1 - THROTTLE_TOLERANCE)) {
+		level += THROTTLE_INCREASE;
+	}
+	level = MAX(THROTTLE_MIN_LEVEL, MIN(1.0f, level));
+
+	updateLimits();
+	pthread_cond_broadcast(&condv);
+	pthread_mutex_unlock(&mutex);
+}
+
+void LoadThrottle::beginLoad() {
+	pthread_mutex_lock(&mutex);
+	while(activeLoads >= loadLimit)
+		pthread_cond_wait(&condv, &mutex);
+	if(activeLoads == 0)
+		busyStart = Utils::getTimeUs();
+	activeLoads++;
+	pthread_mutex_unlock(&mutex);
+}
+
+void LoadThrottle::endLoad(unsigned int points) {
+	pthread_mutex_lock(&mutex);
+	activeLoads--;
+	loadedPoints += points;
+	if(activeLoads == 0)
+		loadTime += Utils::getTimeUs() - busyStart;
+	pthread_cond_signal(&condv);
+	pthread_mutex_unlock(&mutex);
+}
+
+void LoadThrottle::setTargetFrameTime(float t) {
+	pthread_mutex_lock(&mutex);
+	targetFrameTime = t;
+	pthread_mutex_unlock(&mutex);
+}
+
+float LoadThrottle::getLoadRate() {
+	pthread_mutex_lock(&mutex);
+	double busy = loadTime;
+	if(activeLoads > 0)
+		busy += Utils::getTimeUs() - busyStart;
+	float rate = busy > 0 ? loadedPoints / busy * 1000000 : 0;
+	pthread_mutex_unlock(&mutex);
+	return rate;
+}
+
+bool LoadThrottle::isIdle() {
+	return Utils::getTime() - lastMoveTime >= idleTime;
+}
+
+void LoadThrottle::printInfo() {
+	cout << "throttle: frameTime: " << frameTime << " ms target: " << targetFrameTime << " ms level: " << level
+		 << " loads: " << activeLoads << "/" << loadLimit << " (max " << maxLoads << ")"
+		 << " uploadLimit: " << uploadLimit << " idle: " << isIdle() << " load rate: " << getLoadRate()
+		 << " points/s" << endl;
+}
+
+}; //namespace gigapoint
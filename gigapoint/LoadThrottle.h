@@ -0,0 +1,65 @@
+#ifndef _LOAD_THROTTLE_H_
+#define _LOAD_THROTTLE_H_
+
+#include <pthread.h>
+
+namespace gigapoint {
+
+// Feedback controller for loader threads and GPU uploads.
+// Tracks recent frame times and scales the number of concurrent loads and
+// per-frame uploads to stay under targetFrameTime. When the camera has been
+// idle for idleTime the limits ramp back up to full throughput.
+class LoadThrottle {
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t condv;
+
+	float targetFrameTime;	// ms, 0 = disabled
+	unsigned int idleTime;	// ms
+	int maxLoads;
+	int maxUploads;			// 0 = unlimited
+
+	float level;			// (0, 1] fraction of full throughput
+	float frameTime;		// smoothed frame time (ms)
+	int loadLimit;
+	int uploadLimit;
+	int activeLoads;
+	unsigned int lastMoveTime;
+	// measured I/O rate
+	double loadedPoints;
+	double loadTime;		// us of wall clock time with at least one load active
+	unsigned long busyStart;	// us, since when loads are active
+
+	void updateLimits();
+
+public:
+	LoadThrottle(int maxloads, int maxuploads, float targetframetime = 0, unsigned int idletime = 500);
+	~LoadThrottle();
+
+	// called once per frame by the render thread
+	void frame(float frametime, bool cameramoved);
+
+	// called by loader threads around each load, blocks while over the limit
+	void beginLoad();
+	// points of the node loaded, 0 if it failed
+	void endLoad(unsigned int points = 0);
+
+	void setTargetFrameTime(float t);
+	float getTargetFrameTime() { return targetFrameTime; }
+	float getFrameTime() { return frameTime; }
+	float getLevel() { return level; }
+	int getLoadLimit() { return loadLimit; }
+	int getUploadLimit() { return uploadLimit; }
+	int getActiveLoads() { return activeLoads; }
+	bool isIdle();
+	// points per second all loader threads together loaded while busy, as limited
+	// by the throttle and the shared file system
+	float getLoadRate();
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
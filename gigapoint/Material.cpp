@@ -2,9 +2,25 @@
 #include "Utils.h"
 #include <iostream>
 #include <math.h>
+#include <string.h>
 
 namespace gigapoint {
 
+static const char* pointAttributeNames[NUM_POINT_ATTRIBUTES] = {
+	"VertexPosition", "VertexColor"
+};
+static const char* pointUniformNames[NUM_POINT_UNIFORMS] = {
+	"uColorTexture", "uElevationDirection", "uHeightMinMax", "uScreenHeight",
+	"uPointScale", "uPointSizeRange", "uMV", "uMVP"
+};
+static const char* edlAttributeNames[NUM_EDL_ATTRIBUTES] = {
+	"VertexPosition", "VertexTexCoord"
+};
+static const char* edlUniformNames[NUM_EDL_UNIFORMS] = {
+	"uColorTexture", "uScreenWidth", "uScreenHeight", "uNeighbours",
+	"uEdlStrength", "uRadius", "uOpacity"
+};
+
 Material::Material(Option* opt): option(opt) {
 
 	shaderstr = opt->shaderDir;
@@ -23,7 +39,8 @@ void Material::reloadShader() {
 }
 
 //================================
-MaterialPoint::MaterialPoint(Option* option) : Material(option), texture(0) {
+MaterialPoint::MaterialPoint(Option* option) : Material(option), texture(0), depthShader(NULL), frameUbo(0),
+												  frameDirty(true), depthDirty(true), precompileIndex(0) {
 
 	name = "point";
 
@@ -33,26 +50,161 @@ MaterialPoint::MaterialPoint(Option* option) : Material(option), texture(0) {
 	
 	//shader
 	attributes.clear(); uniforms.clear();
-	attributes.push_back("VertexPosition");
-	attributes.push_back("VertexColor");
-
-	uniforms.push_back("uScreenHeight");
-	uniforms.push_back("uSpacing");
-	uniforms.push_back("uPointScale");
-	uniforms.push_back("uPointSizeRange");
-	uniforms.push_back("uColorTexture");
-    uniforms.push_back("uElevationDirection");
-	uniforms.push_back("uHeightMinMax");
-#ifdef STANDALONE_APP
-    uniforms.push_back("uMV");
-    uniforms.push_back("uMVP");
-#endif
+	for(int i=0; i < NUM_POINT_ATTRIBUTES; i++)
+		attributes.push_back(pointAttributeNames[i]);
+	for(int i=0; i < NUM_POINT_UNIFORMS; i++)
+		uniforms.push_back(pointUniformNames[i]);
+
+	memset(&frame, 0, sizeof(FrameUniforms));
 
 	shader = new Shader(name);
+	shader->setCacheDir(option->shaderCacheDir);
 	shaderstr.append("point");
 
 	cout << "shaderstr: " << shaderstr << endl;
 	shader->load(shaderstr, attributes, uniforms, option);
+	pointShader = shader;
+	setupShader(shader);
+}
+
+MaterialPoint::~MaterialPoint() {
+	if(depthShader)
+		delete depthShader;
+	if(frameUbo)
+		glDeleteBuffers(1, &frameUbo);
+}
+
+void MaterialPoint::reloadShader() {
+	shader = pointShader;
+	Material::reloadShader();
+	setupShader(shader);
+	if(depthShader) {
+		depthShader->load(shaderstr, attributes, uniforms, option);
+		setupShader(depthShader);
+	}
+}
+
+void MaterialPoint::setDepthPrepass(bool b) {
+	if(b && !depthShader) {
+		depthShader = new Shader("pointdepth");
+		depthShader->setCacheDir(option->shaderCacheDir);
+		depthShader->load(shaderstr, attributes, uniforms, option);
+		setupShader(depthShader);
+	}
+	shader = b ? depthShader : pointShader;
+}
+
+// variants are the product of size type, material, quality and filter
+bool MaterialPoint::precompileNext() {
+	static const int sizetypes[] = {SIZE_FIXED, SIZE_ADAPTIVE};
+	static const int materials[] = {MATERIAL_RGB, MATERIAL_ELEVATION, MATERIAL_TREEDEPTH};
+	static const int qualities[] = {QUALITY_SQUARE, QUALITY_CIRCLE, QUALITY_SPHERE};
+	static const int filters[] = {FILTER_NONE, FILTER_EDL};
+	static const int numvariants = 2 * 3 * 3 * 2;
+
+	Option variant = *option;
+	while(precompileIndex < numvariants) {
+		int i = precompileIndex++;
+		variant.sizeType = sizetypes[i % 2]; i /= 2;
+		variant.material = materials[i % 3]; i /= 3;
+		variant.quality = qualities[i % 3]; i /= 3;
+		variant.filter = filters[i];
+		if(shader->precompile(shaderstr, attributes, uniforms, &variant))
+			return true;
+	}
+	return false;
+}
+
+// uniforms keep their values in the program, so the sampler is set once here
+// and the frame constants only when they change
+void MaterialPoint::setupShader(Shader* s) {
+	s->bind();
+	s->transmitUniform(UNIFORM_POINT_COLOR_TEXTURE, (int)0);
+	s->unbind();
+	if(s == depthShader)
+		depthDirty = true;
+	else
+		frameDirty = true;
+
+	if(!s->bindUniformBlock("FrameUniforms", FRAME_UNIFORM_BINDING)) {
+		if(frameUbo)
+			glDeleteBuffers(1, &frameUbo);
+		frameUbo = 0;
+		return;
+	}
+	if(!frameUbo) {
+		glGenBuffers(1, &frameUbo);
+		glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &frame, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+}
+
+void MaterialPoint::getRangeInfo(const PCInfo* info, float &range_min, float &range_max, float &range) {
+    if(option->elevationDirection == 0) {
+        range = info->tightBoundingBox[3] - info->tightBoundingBox[0];
+        range_min = info->tightBoundingBox[0] + option->elevationRange[0] * range;
+        range_max = info->tightBoundingBox[0] + option->elevationRange[1] * range;
+    }
+    else if (option->elevationDirection == 1) {
+        range = info->tightBoundingBox[4] - info->tightBoundingBox[1];
+        range_min = info->tightBoundingBox[1] + option->elevationRange[0] * range;
+        range_max = info->tightBoundingBox[1] + option->elevationRange[1] * range;
+    }
+    else {
+        range = info->tightBoundingBox[5] - info->tightBoundingBox[2];
+        range_min = info->tightBoundingBox[2] + option->elevationRange[0] * range;
+        range_max = info->tightBoundingBox[2] + option->elevationRange[1] * range;
+    }
+}
+
+#ifdef STANDALONE_APP
+void MaterialPoint::updateFrameUniforms(const PCInfo* info, const int height, const float MV[16], const float MVP[16]) {
+#else
+void MaterialPoint::updateFrameUniforms(const PCInfo* info, const int height) {
+#endif
+	FrameUniforms f = frame;
+	float range;
+	getRangeInfo(info, f.heightMinMax[0], f.heightMinMax[1], range);
+	f.pointSizeRange[0] = option->pointSizeRange[0];
+	f.pointSizeRange[1] = option->pointSizeRange[1];
+	f.screenHeight = height;
+	f.pointScale = option->pointScale[0];
+	f.elevationDirection = option->elevationDirection;
+#ifdef STANDALONE_APP
+	memcpy(f.MV, MV, 16*sizeof(float));
+	memcpy(f.MVP, MVP, 16*sizeof(float));
+#endif
+	if(memcmp(&f, &frame, sizeof(FrameUniforms)) != 0) {
+		frame = f;
+		frameDirty = depthDirty = true;
+	}
+
+	if(frameUbo) {
+		if(frameDirty) {
+			glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			frameDirty = false;
+		}
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUbo);
+	}
+}
+
+void MaterialPoint::transmitUniforms() {
+	bool& dirty = shader == depthShader ? depthDirty : frameDirty;
+	if(frameUbo || !dirty)
+		return;
+	shader->transmitUniform(UNIFORM_POINT_ELEVATION_DIRECTION, frame.elevationDirection);
+	shader->transmitUniform(UNIFORM_POINT_HEIGHT_MINMAX, frame.heightMinMax[0], frame.heightMinMax[1]);
+	shader->transmitUniform(UNIFORM_POINT_SCREEN_HEIGHT, frame.screenHeight);
+	shader->transmitUniform(UNIFORM_POINT_SCALE, frame.pointScale);
+	shader->transmitUniform(UNIFORM_POINT_SIZE_RANGE, frame.pointSizeRange[0], frame.pointSizeRange[1]);
+#ifdef STANDALONE_APP
+	shader->transmitUniform(UNIFORM_POINT_MV, frame.MV);
+	shader->transmitUniform(UNIFORM_POINT_MVP, frame.MVP);
+#endif
+	dirty = false;
 }
 
 
@@ -63,18 +215,13 @@ MaterialEdl::MaterialEdl(Option* option) : Material(option) {
 
 	//shader
 	attributes.clear(); uniforms.clear();
-	attributes.push_back("VertexPosition");
-	attributes.push_back("VertexTexCoord");
-
-	uniforms.push_back("uColorTexture");
-	uniforms.push_back("uScreenWidth");
-	uniforms.push_back("uScreenHeight");
-	uniforms.push_back("uNeighbours");
-	uniforms.push_back("uEdlStrength");
-	uniforms.push_back("uRadius");
-	uniforms.push_back("uOpacity");
+	for(int i=0; i < NUM_EDL_ATTRIBUTES; i++)
+		attributes.push_back(edlAttributeNames[i]);
+	for(int i=0; i < NUM_EDL_UNIFORMS; i++)
+		uniforms.push_back(edlUniformNames[i]);
 
 	shader = new Shader(name);
+	shader->setCacheDir(option->shaderCacheDir);
 	shaderstr.append("edl");
 
 	cout << "shaderstr: " << shaderstr << endl;
@@ -6,6 +6,57 @@
 
 namespace gigapoint {
 
+// handles of the point shader, in the order given to Shader::load
+enum PointAttribute {
+    ATTR_POINT_POSITION = 0,
+    ATTR_POINT_COLOR,
+    NUM_POINT_ATTRIBUTES
+};
+
+enum PointUniform {
+    UNIFORM_POINT_COLOR_TEXTURE = 0,
+    UNIFORM_POINT_ELEVATION_DIRECTION,
+    UNIFORM_POINT_HEIGHT_MINMAX,
+    UNIFORM_POINT_SCREEN_HEIGHT,
+    UNIFORM_POINT_SCALE,
+    UNIFORM_POINT_SIZE_RANGE,
+    UNIFORM_POINT_MV,
+    UNIFORM_POINT_MVP,
+    NUM_POINT_UNIFORMS
+};
+
+// handles of the edl shader
+enum EdlAttribute {
+    ATTR_EDL_POSITION = 0,
+    ATTR_EDL_TEXCOORD,
+    NUM_EDL_ATTRIBUTES
+};
+
+enum EdlUniform {
+    UNIFORM_EDL_COLOR_TEXTURE = 0,
+    UNIFORM_EDL_SCREEN_WIDTH,
+    UNIFORM_EDL_SCREEN_HEIGHT,
+    UNIFORM_EDL_NEIGHBOURS,
+    UNIFORM_EDL_STRENGTH,
+    UNIFORM_EDL_RADIUS,
+    UNIFORM_EDL_OPACITY,
+    NUM_EDL_UNIFORMS
+};
+
+// std140 layout of the FrameUniforms block in point.vert
+struct FrameUniforms {
+    float MV[16];
+    float MVP[16];
+    float heightMinMax[2];
+    float pointSizeRange[2];
+    float screenHeight;
+    float pointScale;
+    int elevationDirection;
+    int padding;
+};
+
+#define FRAME_UNIFORM_BINDING 0
+
 class Material {
 
 protected:
@@ -20,11 +71,12 @@ protected:
 
 public:
 	Material(Option* option);
+	virtual ~Material() {}
 
 	Shader* getShader() { return shader; };
     Shader* bind();
     Option* getOption() { return option; }
-    void reloadShader();
+    virtual void reloadShader();
 };
 
 
@@ -33,10 +85,35 @@ class MaterialPoint : public Material {
 
 protected:
     ColorTexture* texture;
+    Shader* pointShader;
+    Shader* depthShader;        // depth only variant, created on first use of the prepass
+    FrameUniforms frame;
+    unsigned int frameUbo;      // uniform buffer, 0 when the shader uses plain uniforms
+    bool frameDirty;            // plain uniforms not yet sent to the program
+    bool depthDirty;            // same for the depth shader
+    int precompileIndex;        // next shader variant to compile
+
+    void getRangeInfo(const PCInfo* info, float &min, float &max, float &range);
+    void setupShader(Shader* s);
 
 public:
     MaterialPoint(Option* option);
+    ~MaterialPoint();
     ColorTexture* getColorTexture() { return texture; }
+    void reloadShader();
+    // compiles the next shader variant that is not cached, false when all are done
+    bool precompileNext();
+    // getShader returns the depth only shader while set
+    void setDepthPrepass(bool b);
+
+    // once per frame, before drawing
+#ifdef STANDALONE_APP
+    void updateFrameUniforms(const PCInfo* info, const int height, const float MV[16], const float MVP[16]);
+#else
+    void updateFrameUniforms(const PCInfo* info, const int height);
+#endif
+    // shader must be bound, only sends what changed since the last call
+    void transmitUniforms();
 };
 
 
@@ -1,5 +1,6 @@
 #include "Utils.h"
 #include "NodeGeometry.h"
+#include "CacheSnapshot.h"
 
 #include <iostream>
 #include <fstream>
@@ -9,6 +10,7 @@
 #include <map>
 #include <math.h>
 #include <sstream>
+#include <string.h>
 
 using namespace std;
 #ifndef STANDALONE_APP
@@ -17,9 +19,13 @@ using namespace omega;
 
 namespace gigapoint {
 
-NodeGeometry::NodeGeometry(string _name): index(-1), numpoints(0), level(-1), parent(NULL),updateCache(NULL),
-										  hierachyloaded(false), loadstate(STATE_NONE), initvbo(false), haschildren(false),
-                                          vertexbuffer(-1), colorbuffer(-1), dirty(false),updating(false),datafile("unset")
+NodeGeometry::NodeGeometry(string _name): index(-1), numpoints(0), level(-1), initvbo(false), hierachyloaded(false),
+										  loadstate(STATE_NONE), updating(false), dirty(false), errorcache(NULL),
+                                          bufferpool(NULL), stagingring(NULL), stagingslot(-1), visibleframe(0), visibleindex(-1), visibletime(0), numflips(0), drawn(false),
+                                          prefetched(false), prefetchframe(0), drawcount(-1),
+                                          parent(NULL), updateCache(NULL), haschildren(false), datafile("unset"),
+                                          numloaderrors(0), loadfailtime(0), loadretrydelay(0),
+                                          numhrcerrors(0), hrcfailtime(0), hrcretrydelay(0)
                                           {
 	name = _name;
 	//tightbbox[0] = tightbbox[1] = tightbbox[2] = FLT_MAX;
@@ -85,6 +91,9 @@ int NodeGeometry::loadHierachy(LRUCache* lrucache, bool force) {
 	if(hierachyloaded && !force)
         return 0;
 
+	if(!canRetryHierarchy())
+		return -1;
+
     hrc_filename = info->dataDir + info->octreeDir + "/" + getHierarchyPath() + name + ".hrc";
 
 	assert(info);
@@ -103,10 +112,15 @@ int NodeGeometry::loadHierachy(LRUCache* lrucache, bool force) {
 	FILE *f;long len; unsigned char *data;
 	f=fopen(hrc_filename.c_str(),"rb");
 	if(f == NULL){
-		std::cout << "Cannot find " << hrc_filename << "!!!" << std::endl;
+		hierarchyFailed(hrc_filename);
 		return -1;
 	}
 	fseek(f,0,SEEK_END);len=ftell(f);fseek(f,0,SEEK_SET);
+	if(len < 5) {
+		fclose(f);
+		hierarchyFailed(hrc_filename);
+		return -1;
+	}
 	data= new unsigned char[len+1];fread(data,1,len,f);fclose(f);
 
 	// root of subtree
@@ -185,6 +199,7 @@ int NodeGeometry::loadHierachy(LRUCache* lrucache, bool force) {
             Utils::createChildAABB(pnode->getTightBBox(), cindex, tightcbbox);
             cnode->setBBox(cbbox);
             cnode->setInfo(pnode->getInfo());
+            cnode->setErrorCache(pnode->getErrorCache());
             cnode->setTightBBox(tightcbbox);
             //cnode->printInfo();
             pnode->addChild(cnode);
@@ -194,10 +209,38 @@ int NodeGeometry::loadHierachy(LRUCache* lrucache, bool force) {
         }
     }
 
+	delete [] data;
+
+	if(numhrcerrors > 0) {
+		numhrcerrors = 0;
+		if(errorcache)
+			errorcache->reportSuccess(hrc_filename);
+	}
+
 	hierachyloaded = true;    
 	return 0;
 }
 
+void NodeGeometry::hierarchyFailed(const string& filename) {
+	numhrcerrors++;
+	hrcfailtime = Utils::getTime();
+	if(errorcache)
+		hrcretrydelay = errorcache->reportFailure(filename, LOAD_ERROR_HIERARCHY);
+	else
+		std::cout << "Cannot find " << filename << "!!!" << std::endl;
+}
+
+void NodeGeometry::loadFailed(int error, const string& filename) {
+	unsigned int delay = 0;
+	if(errorcache)
+		delay = errorcache->reportFailure(filename, error);
+	if(error == LOAD_ERROR_TRUNCATED)
+		return;
+	numloaderrors++;
+	loadfailtime = Utils::getTime();
+	loadretrydelay = delay;
+}
+
 
 ifstream::pos_type NodeGeometry::getFilesize(const char* filename)
 {
@@ -205,7 +248,7 @@ ifstream::pos_type NodeGeometry::getFilesize(const char* filename)
         return in.tellg();
 }
 
-int NodeGeometry::loadData() {
+int NodeGeometry::loadData(StagingRing* ring, CacheSnapshot* snapshot) {
 
     if(isLoaded())
         return 0;
@@ -214,6 +257,13 @@ int NodeGeometry::loadData() {
 
     loadstate = STATE_LOADING;
 
+    // decoded by an earlier run. Most restored nodes are not drawn soon, they would hold
+    // staging slots until they are evicted.
+    if(snapshot && snapshot->restore(name, vertices, colors)) {
+        loadstate = STATE_LOADED;
+        return 0;
+    }
+
 	string filename = info->dataDir + info->octreeDir + "/" + getHierarchyPath() + name + ".bin";
     // cout << "Load file: " << filename << endl;
 	datafile = filename;
@@ -221,12 +271,19 @@ int NodeGeometry::loadData() {
 
 	ifstream reader;
 	reader.open (filename.c_str(), ifstream::in | ifstream::binary);
-	
+	if(!reader.is_open()) {
+		loadFailed(LOAD_ERROR_MISSING, filename);
+		loadstate = STATE_NONE;
+		return -1;
+	}
+
+	bool truncated = false;
 	while(reader.good()) {
 		char* buffer = new char[info->pointByteSize];
 		reader.read(buffer, info->pointByteSize);
 
 		if(!reader.good()){
+			truncated = reader.gcount() > 0;
 			if(buffer)
             	delete [] buffer;
 			break;
@@ -279,12 +336,54 @@ int NodeGeometry::loadData() {
 
 	reader.close();
     //cout << "done reading " << filename.c_str() << std::endl;
-    
-    loadstate = vertices.size() > 0 ? STATE_LOADED : STATE_NONE;
+
+    if(vertices.size() == 0) {
+        loadFailed(LOAD_ERROR_EMPTY, filename);
+        loadstate = STATE_NONE;
+        return -1;
+    }
+
+    if(truncated)
+        loadFailed(LOAD_ERROR_TRUNCATED, filename);
+
+    if(numloaderrors > 0) {
+        numloaderrors = 0;
+        if(errorcache)
+            errorcache->reportSuccess(filename);
+    }
+
+    // copy to GPU visible memory here so the render thread only issues the copy
+    if(ring)
+        stageData(ring);
+
+    loadstate = STATE_LOADED;
   
     return 0;
 }
 
+// The node keeps its decoded vertices and colors (occlusion buffer, picking, fracture
+// tracer, cache snapshot), so the slot gets a copy instead of the decoder writing into it.
+// Two sequential memcpys also suit write-combined mapped memory better than the
+// decoder's scattered per point writes.
+void NodeGeometry::stageData(StagingRing* ring) {
+    if(stagingslot >= 0)
+        return;
+
+    unsigned int vsize = vertices.size()*sizeof(float);
+    unsigned int csize = colors.size()*sizeof(unsigned char);
+    void* ptr = NULL;
+    int slot = ring->acquire(vsize + csize, &ptr);
+    if(slot < 0)
+        return;
+
+    memcpy(ptr, &vertices[0], vsize);
+    if(csize > 0)
+        memcpy((char*)ptr + vsize, &colors[0], csize);
+    ring->commit(slot);
+    stagingring = ring;
+    stagingslot = slot;
+}
+
 void NodeGeometry::printInfo() {
 	cout << endl << "Node: " << name << " level: " << level << " index: " << index << endl;
     cout << "# points: " << numpoints << " loaded " << isLoaded() << endl;
@@ -317,60 +416,58 @@ void NodeGeometry::printInfo() {
 	}
 
 	if(initvbo)
-		cout << "vertexbuffer: " << vertexbuffer << " colorbuffer: " << colorbuffer << endl;
+		cout << "buffer page: " << gpurange.page << " first: " << gpurange.first << " count: " << gpurange.count << endl;
     cout << "dirty: " << dirty << endl;
     cout << "updatecache: " << (updateCache!=NULL) << endl;
+    if(numloaderrors > 0 || numhrcerrors > 0)
+        cout << "load errors: " << numloaderrors << " hierarchy errors: " << numhrcerrors << endl;
+    cout << "visible flips: " << numflips << " drawn: " << drawn << " prefetched: " << prefetched << endl;
 }
 
-int NodeGeometry::initVBO() {
-    if(initvbo) {
-        std::cout << "reinitializing VBO of Node " << name << std::endl;
-        glDeleteBuffers(1, &vertexbuffer);
-        glDeleteBuffers(1, &colorbuffer);
+int NodeGeometry::initVBO(BufferPool* pool) {
+    if(pool)
+        bufferpool = pool;
+    assert(bufferpool);
+
+    unsigned int numpoints = vertices.size() / 3;
+    if(initvbo && gpurange.count != numpoints) {
+        bufferpool->free(gpurange);
         initvbo = false;
     }
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-	glGenBuffers(1, &colorbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
-	glBufferData(GL_ARRAY_BUFFER, colors.size()*sizeof(unsigned char), &colors[0], GL_STATIC_DRAW);
+    if(!initvbo && !bufferpool->allocate(numpoints, gpurange))
+        return -1;
+
+    unsigned int buffer = bufferpool->getBuffer(gpurange.page);
+    unsigned int voffset = bufferpool->getVertexOffset(gpurange);
+    unsigned int coffset = bufferpool->getColorOffset(gpurange);
+    unsigned int vsize = vertices.size()*sizeof(float);
+    unsigned int csize = colors.size()*sizeof(unsigned char);
+
+    if(stagingslot >= 0) {
+        // data is already in a staging buffer, only issue GPU copies
+        stagingring->copy(stagingslot, buffer, voffset, vsize, buffer, coffset, csize);
+        stagingslot = -1;
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, voffset, vsize, &vertices[0]);
+        if(csize > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, coffset, csize, &colors[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
     initvbo = true;
 
     return 0;
 }
     
-void NodeGeometry::getRangeInfo(const Option* option, float &range_min, float &range_max, float &range) {
-    if(option->elevationDirection == 0) {
-        range = info->tightBoundingBox[3] - info->tightBoundingBox[0];
-        range_min = info->tightBoundingBox[0] + option->elevationRange[0] * range;
-        range_max = info->tightBoundingBox[0] + option->elevationRange[1] * range;
-    }
-    else if (option->elevationDirection == 1) {
-        range = info->tightBoundingBox[4] - info->tightBoundingBox[1];
-        range_min = info->tightBoundingBox[1] + option->elevationRange[0] * range;
-        range_max = info->tightBoundingBox[1] + option->elevationRange[1] * range;
-    }
-    else {
-        range = info->tightBoundingBox[5] - info->tightBoundingBox[2];
-        range_min = info->tightBoundingBox[2] + option->elevationRange[0] * range;
-        range_max = info->tightBoundingBox[2] + option->elevationRange[1] * range;
-    }
-}
+// frame uniforms are set by MaterialPoint::updateFrameUniforms
+void NodeGeometry::draw(Material* material) {
 
-#ifdef STANDALONE_APP
-void NodeGeometry::draw(const float MV[16], const float MVP[16], Material* material, const int height) {
-#else
-void NodeGeometry::draw(Material* material, const int height) {
-#endif
-    
-	if(isLoading() || !isLoaded())
+	// uploads are done by PointCloud::uploadNodes within the frame budget
+	if(isLoading() || !isLoaded() || !initvbo)
 		return;
-    
-	if(!initvbo)
-		initVBO();
+	drawn = true;
 	
     Shader* shader = material->getShader();
 	Option* option = material->getOption();
@@ -381,10 +478,10 @@ void NodeGeometry::draw(Material* material, const int height) {
 	if(oglError) return;
 #endif
 	
-    unsigned int attribute_vertex_pos = shader->attribute("VertexPosition");
-    //cout << "Vertex Position: " << attribute_vertex_pos << endl;
+    unsigned int attribute_vertex_pos = shader->attribute(ATTR_POINT_POSITION);
+    // attribute pointers are set to the start of the page, the node is drawn from gpurange.first
     glEnableVertexAttribArray(attribute_vertex_pos);  // Vertex position
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferpool->getBuffer(gpurange.page));
     glVertexAttribPointer(
         attribute_vertex_pos, // attribute
         3,                 // number of elements per vertex, here (x,y,z)
@@ -399,37 +496,24 @@ void NodeGeometry::draw(Material* material, const int height) {
 
     unsigned int attribute_color_pos;
     if(option->material == MATERIAL_RGB) {
-    attribute_color_pos = shader->attribute("VertexColor");
-    //cout << "Vertex Color: " << attribute_color_pos << endl;   
+    attribute_color_pos = shader->attribute(ATTR_POINT_COLOR);
     glEnableVertexAttribArray(attribute_color_pos);  // Vertex position
-    glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
     glVertexAttribPointer(
         attribute_color_pos, // attribute
         3,                 // number of elements per vertex, here (r, g, b)
         GL_UNSIGNED_BYTE,  // the type of each element
         GL_FALSE,          // take our values as-is
         0,                 // no extra data between each position
-        0                  // offset of first element
+        (const GLvoid*)(size_t)(bufferpool->getCapacity(gpurange.page) * POOL_VERTEX_SIZE) // colours follow all positions
     );
 #ifndef STANDALONE_APP
     if(oglError) return;
 #endif
     }
 	
-	shader->transmitUniform("uColorTexture", (int)0);
-    float range, range_min, range_max;
-    getRangeInfo(option, range_min, range_max, range);
-    shader->transmitUniform("uElevationDirection", option->elevationDirection);
-	shader->transmitUniform("uHeightMinMax", range_min, range_max);
-	shader->transmitUniform("uScreenHeight", (float)height);
-    shader->transmitUniform("uPointScale", (float)option->pointScale[0]);
-    shader->transmitUniform("uPointSizeRange", (float)option->pointSizeRange[0], (float)option->pointSizeRange[1]);
-#ifdef STANDALONE_APP
-    shader->transmitUniform("uMV", MV);
-    shader->transmitUniform("uMVP", MVP);
-#endif
+    ((MaterialPoint*)material)->transmitUniforms();
 
-	glDrawArrays(GL_POINTS, 0, vertices.size()/3);
+	glDrawArrays(GL_POINTS, gpurange.first, getDrawCount());
 #ifndef STANDALONE_APP
 	if(oglError) return;
 #endif
@@ -445,14 +529,19 @@ void NodeGeometry::draw(Material* material, const int height) {
 
 void NodeGeometry::freeData(bool keepupdatecache) {
 	//cout << "Free data for node: " << name << endl;
+	if(stagingslot >= 0) {
+		stagingring->discard(stagingslot);
+		stagingslot = -1;
+	}
 	if(initvbo) {
-		glDeleteBuffers(1, &vertexbuffer);
-		glDeleteBuffers(1, &colorbuffer);
+		bufferpool->free(gpurange);
 		initvbo = false;
 	}
 	if(isLoaded()) {
 		vertices.clear();
 		colors.clear();
+		drawn = false;
+		prefetched = false;
         if (!keepupdatecache) // to prevent this node from landing in the loadingqueue  again
             loadstate = STATE_NONE;
 	}
@@ -486,6 +575,7 @@ void NodeGeometry::Update() {
         if ( (children[i] == NULL) && (updateCache->children[i] != NULL) ) {
             cout << "node has new child" << name << " " << updateCache->children[i]->name << endl;
             children[i]=updateCache->children[i];
+            childbounds.set(i, children[i]->getBBox());
         }
     }
 
@@ -511,6 +601,7 @@ void NodeGeometry::initUpdateCache()
     updating=true;
     updateCache = new NodeGeometry(name);
     updateCache->setInfo(info);
+    updateCache->setErrorCache(errorcache);
     updateCache->setBBox(getBBox());
 
     updateCache->setIndex(index);
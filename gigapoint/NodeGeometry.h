@@ -4,6 +4,10 @@
 #include "Utils.h"
 #include "Material.h"
 #include "LRU.h"
+#include "LoadErrorCache.h"
+#include "StagingRing.h"
+#include "BufferPool.h"
+#include "FrustumCuller.h"
 
 #include <string>
 #include <vector>
@@ -25,6 +29,7 @@ struct HRC_Item {
 };
 
 class LRUCache;
+class CacheSnapshot;
 
 enum LoadState {
 	STATE_NONE = 0,
@@ -57,21 +62,41 @@ private:
 
     string hrc_filename;
 	PCInfo* info;
+	LoadErrorCache* errorcache;
     ifstream::pos_type getFilesize(const char* filename);
 
 	//data
 	vector<float> vertices;
 	vector<unsigned char> colors;
-	unsigned int vertexbuffer;
-	unsigned int colorbuffer;
+	BufferPool* bufferpool;
+	BufferRange gpurange;	// points of this node in the buffer pool
+	StagingRing* stagingring;
+	int stagingslot;	// slot holding the decoded data until it is uploaded
+	unsigned int visibleframe;	// last visibility traversal the node was in the display list
+	int visibleindex;			// position in that traversal's node list
+	unsigned int visibletime;	// ms, last time it was selected
+	int numflips;				// times it came back into the visible set
+	bool drawn;					// drawn since its data was loaded
+	bool prefetched;			// queued for a predicted view and not visible since
+	unsigned int prefetchframe;	// last prefetch traversal that selected it
+	unsigned int drawcount;	// prefix of the points drawn this frame
 	Shader* shader;
 
 	NodeGeometry* parent;
 	NodeGeometry* children[8];
+	ChildBounds childbounds;	// bboxes of the children for culling them together
     NodeGeometry* updateCache;
 
 	bool haschildren;
 	string datafile;
+
+	// negative cache: failure counters and backoff of .bin and .hrc files
+	int numloaderrors;
+	unsigned int loadfailtime;
+	unsigned int loadretrydelay;
+	int numhrcerrors;
+	unsigned int hrcfailtime;
+	unsigned int hrcretrydelay;
     bool updateFinished() {
         if (updateCache != NULL)
             if (updateCache->isLoaded())
@@ -80,7 +105,8 @@ private:
     }
     
 private:
-    void getRangeInfo(const Option* option, float &min, float &max, float &range);
+    void loadFailed(int error, const string& filename);
+    void hierarchyFailed(const string& filename);
 
 public:
 	NodeGeometry(string name);
@@ -99,16 +125,26 @@ public:
     
     void setState(LoadState s) { loadstate = s; }
     bool inQueue() { return loadstate == STATE_INQUEUE; }
-    bool canAddToQueue() { return loadstate == STATE_NONE; }
+    bool canAddToQueue() { return loadstate == STATE_NONE && canRetryLoad(); }
     bool isLoading() { return loadstate == STATE_LOADING; }
     bool isLoaded()  { return loadstate == STATE_LOADED; }
 
 	void setInfo(PCInfo* in) { info = in; }
 	PCInfo* getInfo() { return info; }
+	void setErrorCache(LoadErrorCache* cache) { errorcache = cache; }
+	LoadErrorCache* getErrorCache() { return errorcache; }
+
+	// backoff after failed loads
+	bool canRetryLoad() { return numloaderrors == 0 || Utils::getTime() - loadfailtime >= loadretrydelay; }
+	bool canRetryHierarchy() { return numhrcerrors == 0 || Utils::getTime() - hrcfailtime >= hrcretrydelay; }
+	int getNumLoadErrors() { return numloaderrors; }
+	int getNumHierarchyErrors() { return numhrcerrors; }
+	unsigned int getHierarchyRetryTime() { return hrcfailtime + hrcretrydelay; }
 
 	void setParent(NodeGeometry* p) { parent = p;}
-	void addChild(NodeGeometry* c) { children[c->getIndex()] = c; }
+	void addChild(NodeGeometry* c) { children[c->getIndex()] = c; childbounds.set(c->getIndex(), c->getBBox()); }
 	NodeGeometry* getChild(int i) { return children[i]; }
+	const ChildBounds& getChildBounds() { return childbounds; }
 
 	string getName() { return name; }
     
@@ -125,14 +161,34 @@ public:
 	string getHierarchyPath();
     int loadHierachy(LRUCache* lrucache, bool force=false);
     bool canLoadHierarchy() {return (level % info->hierarchyStepSize) == 0;}
-	int loadData();
+	// restored from snapshot if it holds the node, otherwise read from its .bin file and
+	// staged in ring if it is given
+	int loadData(StagingRing* ring = NULL, CacheSnapshot* snapshot = NULL);
+	void stageData(StagingRing* ring);
+	bool isStaged() { return stagingslot >= 0; }
+	unsigned int getVisibleFrame() { return visibleframe; }
+	void setVisibleFrame(unsigned int f, int index) { visibleframe = f; visibleindex = index; }
+	int getVisibleIndex() { return visibleindex; }
+	unsigned int getVisibleTime() { return visibletime; }
+	void setVisibleTime(unsigned int t) { visibletime = t; }
+	int getNumFlips() { return numflips; }
+	void addFlip() { numflips++; }
+	bool wasDrawn() { return drawn; }
+	void setDrawn() { drawn = true; }
+	bool isPrefetched() { return prefetched; }
+	void setPrefetched(bool b) { prefetched = b; }
+	unsigned int getPrefetchFrame() { return prefetchframe; }
+	void setPrefetchFrame(unsigned int f) { prefetchframe = f; }
+	void setDrawCount(unsigned int n) { drawcount = n; }
+	unsigned int getDrawCount() { return drawcount < gpurange.count ? drawcount : gpurange.count; }
 	void printInfo();
-	int initVBO();
-#ifdef STANDALONE_APP
-	void draw(const float MV[16], const float MVP[16], Material* material, const int height);
-#else
-    void draw(Material* material, const int height);
-#endif
+	int initVBO(BufferPool* pool = NULL);
+	bool hasVBO() { return initvbo; }
+	const BufferRange& getBufferRange() { return gpurange; }
+	const vector<float>& getVertices() { return vertices; }
+	const vector<unsigned char>& getColors() { return colors; }
+	unsigned int getDataSize() { return vertices.size()*sizeof(float) + colors.size()*sizeof(unsigned char); }
+	void draw(Material* material);
     void freeData(bool keepupdatecache=false);
 
 	//interaction
@@ -0,0 +1,170 @@
+#include "OcclusionBuffer.h"
+
+#include <iostream>
+#include <math.h>
+#include <float.h>
+
+using namespace std;
+
+namespace gigapoint {
+
+#define OCCLUSION_NEAR 0.00001f
+
+OcclusionBuffer::OcclusionBuffer(int w, int h): width(w), height(h), numOccluders(0), numPoints(0),
+												numTests(0), numOccluded(0), buildTime(0), buildStart(0) {
+	for(int i=0; i < 16; i++)
+		MVP[i] = 0;
+	scale[0] = scale[1] = 0;
+
+	// pyramid down to a single cell
+	int lw = width, lh = height;
+	for(;;) {
+		levels.push_back(vector<float>(lw * lh, FLT_MAX));
+		levelWidth.push_back(lw);
+		levelHeight.push_back(lh);
+		if(lw == 1 && lh == 1)
+			break;
+		lw = (lw + 1) / 2;
+		lh = (lh + 1) / 2;
+	}
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+}
+
+void OcclusionBuffer::begin(const float mvp[16]) {
+	for(int i=0; i < 16; i++)
+		MVP[i] = mvp[i];
+	scale[0] = sqrt(MVP[0]*MVP[0] + MVP[4]*MVP[4] + MVP[8]*MVP[8]) * width * 0.5f;
+	scale[1] = sqrt(MVP[1]*MVP[1] + MVP[5]*MVP[5] + MVP[9]*MVP[9]) * height * 0.5f;
+
+	vector<float>& depth = levels[0];
+	for(int i=0; i < depth.size(); i++)
+		depth[i] = FLT_MAX;
+	numOccluders = 0;
+	numPoints = 0;
+	numTests = 0;
+	numOccluded = 0;
+	buildStart = Utils::getTimeUs();
+}
+
+// cells completely inside the square splat take its depth if it is nearer
+void OcclusionBuffer::splat(float cx, float cy, float hx, float hy, float depth) {
+	int x0 = ceil(cx - hx), x1 = floor(cx + hx) - 1;
+	int y0 = ceil(cy - hy), y1 = floor(cy + hy) - 1;
+	if(x0 < 0) x0 = 0;
+	if(y0 < 0) y0 = 0;
+	if(x1 >= width) x1 = width - 1;
+	if(y1 >= height) y1 = height - 1;
+
+	vector<float>& cells = levels[0];
+	for(int y=y0; y <= y1; y++) {
+		float* row = &cells[y * width];
+		for(int x=x0; x <= x1; x++) {
+			if(depth < row[x])
+				row[x] = depth;
+		}
+	}
+}
+
+void OcclusionBuffer::addOccluder(NodeGeometry* node, float spacing) {
+	if(!node->isLoaded() || isFull())
+		return;
+	const vector<float>& vertices = node->getVertices();
+	int total = vertices.size() / 3;
+	int n = total;
+	if(n > OCCLUSION_POINTS_PER_NODE)
+		n = OCCLUSION_POINTS_PER_NODE;
+	if(n > OCCLUSION_MAX_POINTS - numPoints)
+		n = OCCLUSION_MAX_POINTS - numPoints;
+	if(n <= 0)
+		return;
+
+	// a prefix of the points covers less of the node, but splats larger than the point spacing
+	// would close real gaps in sparse geometry and cull visible nodes
+	float size = 0.5f * spacing;
+	for(int i=0; i < n; i++) {
+		const float* p = &vertices[3*i];
+		float w = MVP[3]*p[0] + MVP[7]*p[1] + MVP[11]*p[2] + MVP[15];
+		if(w <= OCCLUSION_NEAR)
+			continue;
+		float x = MVP[0]*p[0] + MVP[4]*p[1] + MVP[8]*p[2] + MVP[12];
+		float y = MVP[1]*p[0] + MVP[5]*p[1] + MVP[9]*p[2] + MVP[13];
+		splat((x / w * 0.5f + 0.5f) * width, (y / w * 0.5f + 0.5f) * height,
+			  size * scale[0] / w, size * scale[1] / w, w);
+	}
+	numOccluders++;
+	numPoints += n;
+}
+
+// a cell of a higher level is as far as the farthest of its cells
+void OcclusionBuffer::end() {
+	for(int l=1; l < levels.size(); l++) {
+		const vector<float>& below = levels[l-1];
+		vector<float>& cells = levels[l];
+		int bw = levelWidth[l-1], bh = levelHeight[l-1];
+		int lw = levelWidth[l], lh = levelHeight[l];
+		for(int y=0; y < lh; y++) {
+			for(int x=0; x < lw; x++) {
+				float d = 0;
+				for(int j=2*y; j <= 2*y+1 && j < bh; j++)
+					for(int i=2*x; i <= 2*x+1 && i < bw; i++)
+						if(below[j * bw + i] > d)
+							d = below[j * bw + i];
+				cells[y * lw + x] = d;
+			}
+		}
+	}
+	buildTime = (Utils::getTimeUs() - buildStart) / 1000.0;
+}
+
+bool OcclusionBuffer::isOccluded(const float bbox[6]) {
+	numTests++;
+	if(numPoints == 0)
+		return false;
+
+	float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+	float mindepth = FLT_MAX;
+	for(int i=0; i < 8; i++) {
+		float p[3] = { bbox[i & 1 ? 3 : 0], bbox[i & 2 ? 4 : 1], bbox[i & 4 ? 5 : 2] };
+		float w = MVP[3]*p[0] + MVP[7]*p[1] + MVP[11]*p[2] + MVP[15];
+		if(w <= OCCLUSION_NEAR)
+			return false;
+		float x = ((MVP[0]*p[0] + MVP[4]*p[1] + MVP[8]*p[2] + MVP[12]) / w * 0.5f + 0.5f) * width;
+		float y = ((MVP[1]*p[0] + MVP[5]*p[1] + MVP[9]*p[2] + MVP[13]) / w * 0.5f + 0.5f) * height;
+		if(x < minx) minx = x;
+		if(x > maxx) maxx = x;
+		if(y < miny) miny = y;
+		if(y > maxy) maxy = y;
+		if(w < mindepth) mindepth = w;
+	}
+
+	if(maxx < 0 || maxy < 0 || minx >= width || miny >= height)
+		return false;
+	int x0 = minx < 0 ? 0 : (int)minx;
+	int y0 = miny < 0 ? 0 : (int)miny;
+	int x1 = maxx >= width ? width - 1 : (int)maxx;
+	int y1 = maxy >= height ? height - 1 : (int)maxy;
+
+	// the level where the box covers at most 2x2 cells
+	int l = 0;
+	while(l < levels.size() - 1 && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+		l++;
+	const vector<float>& cells = levels[l];
+	int lw = levelWidth[l];
+	for(int y=(y0 >> l); y <= (y1 >> l); y++)
+		for(int x=(x0 >> l); x <= (x1 >> l); x++)
+			if(cells[y * lw + x] >= mindepth)
+				return false;
+
+	numOccluded++;
+	return true;
+}
+
+void OcclusionBuffer::printInfo() {
+	cout << "occlusion buffer: " << width << "x" << height << " occluders: " << numOccluders << " nodes, "
+		 << numPoints << " points, build: " << buildTime << " ms, tests: " << numTests
+		 << " occluded: " << numOccluded << endl;
+}
+
+}; //namespace gigapoint
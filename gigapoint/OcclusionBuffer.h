@@ -0,0 +1,58 @@
+#ifndef _OCCLUSION_BUFFER_H_
+#define _OCCLUSION_BUFFER_H_
+
+#include "NodeGeometry.h"
+
+#include <vector>
+
+namespace gigapoint {
+
+#define OCCLUSION_POINTS_PER_NODE 256	// prefix of a node's points splatted as occluders
+#define OCCLUSION_MAX_POINTS 262144		// occluder points per build
+
+// Software depth buffer for occlusion culling of octree nodes on the CPU.
+// Occluder points are splatted as squares of their point spacing and a cell
+// keeps the nearest view depth at which a splat covers it completely. Levels
+// above keep the farthest depth of their 2x2 cells (hierarchical Z), so a
+// bounding box is tested against at most 2x2 cells of the level it fits.
+class OcclusionBuffer {
+
+private:
+	int width, height;
+	std::vector< std::vector<float> > levels;	// level 0 is width x height
+	std::vector<int> levelWidth;
+	std::vector<int> levelHeight;
+	float MVP[16];
+	float scale[2];		// cells per world unit at view depth 1
+
+	// stats
+	int numOccluders;
+	int numPoints;
+	int numTests;
+	int numOccluded;
+	float buildTime;		// ms
+	unsigned long buildStart;
+
+	void splat(float cx, float cy, float hx, float hy, float depth);
+
+public:
+	OcclusionBuffer(int width, int height);
+	~OcclusionBuffer();
+
+	// clears the buffer for a new view
+	void begin(const float MVP[16]);
+	// splats a prefix of the loaded points of node, spacing is the node's point spacing
+	void addOccluder(NodeGeometry* node, float spacing);
+	// builds the pyramid
+	void end();
+	bool isFull() { return numPoints >= OCCLUSION_MAX_POINTS; }
+
+	// true when the box is completely behind occluders
+	bool isOccluded(const float bbox[6]);
+
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
@@ -3,6 +3,11 @@
 #include "FractureTracer.h"
 
 #include <iostream>
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using namespace std;
 #ifndef STANDALONE_APP
@@ -15,27 +20,85 @@ using namespace omicron;
 
 namespace gigapoint {
 
-
-PointCloud::PointCloud(Option* opt, bool mas): option(opt), master(mas), pauseUpdate(false),fullReload(false),
-                                               width(0), height(0),interactMode(INTERACT_NONE), frameBuffer(0),
-                                               lrucache(NULL),_unload(false),render(true),
-                                               materialPoint(0), materialEdl(0),quadVao(0), quadVbo(0),
-                                               needReloadShader(false), printInfo(false),tracer(NULL) {
-
+#define PRELOAD_POLL_INTERVAL 10000	// us between progress checks of a blocking preload
+#define OCCLUSION_MAX_TURN 10		// degrees a view may turn between traversals to keep occlusion culling
+
+PointCloud::PointCloud(Option* opt, bool mas): master(mas), pauseUpdate(false), fullReload(false), _unload(false), render(true), width(0),
+                                               height(0), materialPoint(0), materialEdl(0), frameBuffer(0), numViews(0), drawView(0), warnedViews(false),
+                                               gazeEnabled(false), needTraversal(true), hierarchyRetryTime(0), visibilityFrame(0), numFlips(0), totalFlips(0), maxFlips(0),
+                                               drawListChanged(true), numTraversals(0), numSkippedTraversals(0), lastTraversalFrames(0),
+                                               needReloadShader(false), shadersPrecompiled(false), printInfo(false), option(opt), throttle(NULL),
+                                               cameraMoved(true), governor(NULL), stagingring(NULL), bufferpool(NULL),
+                                               submitTime(0), fragmentcounter(NULL), numOcclusionSkipped(0), predictor(NULL), prefetchFrame(0),
+                                               numPrefetched(0), numPrefetchHits(0), numPrefetchLate(0), numPrefetchMisses(0),
+                                               numPrefetchCancelled(0), numGuardNodes(0), needPrefetch(false), tourStarted(false), tourStart(0),
+                                               tourNext(0), numTourNodes(0), numTourStalls(0), numTourMissing(0), heatmap(NULL), lastDisplayTime(0),
+                                               warmupNext(0), warmupBytes(0), preloadStart(0), preloadDone(0), preloadCallback(NULL),
+                                               preloadCallbackData(NULL), snapshot(NULL), newFrame(true), numUploads(0), uploadBacklog(0), uploadMBPerFrame(0),
+                                               uploadTime(0), lrucache(NULL), errorcache(NULL), interactMode(INTERACT_NONE), tracer(NULL),
+                                               quadVao(0), quadVbo(0) {
+	for(int v=0; v < MAX_VIEWS; v++)
+		for(int i=0; i < 16; i++)
+			lastMVP[v][i] = 0;
+	for(int i=0; i < 3; i++)
+		gazeOrigin[i] = gazeDirection[i] = 0;
+	for(int v=0; v < MAX_VIEWS; v++) {
+		batchrenderers[v] = NULL;
+		batchDirty[v] = true;
+		occlusionbuffers[v] = NULL;
+	}
 }
 
 PointCloud::~PointCloud() {
+	// written while the tree and pcinfo are still there
+	if(snapshot) {
+		saveSnapshot();
+		delete snapshot;
+	}
     // destroy tree
 	if(pcinfo)
 		delete pcinfo;
     if(tracer)
         delete tracer;
+    if(errorcache)
+        delete errorcache;
+    if(governor)
+        delete governor;
 	if(materialPoint)
 		delete materialPoint;
 	if(materialEdl)
 		delete materialEdl;
 	if(frameBuffer)
 		delete frameBuffer;
+	if(stagingring) {
+		stagingring->destroy();
+		delete stagingring;
+	}
+	for(int v=0; v < MAX_VIEWS; v++) {
+		if(batchrenderers[v]) {
+			batchrenderers[v]->destroy();
+			delete batchrenderers[v];
+		}
+	}
+	if(bufferpool) {
+		bufferpool->destroy();
+		delete bufferpool;
+	}
+	if(fragmentcounter) {
+		fragmentcounter->destroy();
+		delete fragmentcounter;
+	}
+	for(int v=0; v < MAX_VIEWS; v++)
+		if(occlusionbuffers[v])
+			delete occlusionbuffers[v];
+	if(predictor)
+		delete predictor;
+	if(heatmap) {
+		recordAccess();
+		if(master)
+			heatmap->save();
+		delete heatmap;
+	}
 	if (glIsBuffer(quadVbo))
 		glDeleteBuffers(1, &quadVbo);
 	if (glIsVertexArray(quadVao))
@@ -56,6 +119,15 @@ void PointCloud::initMaterials() {
 		if(oglError) return;
 #endif
 	}
+	if(!bufferpool)
+		bufferpool = new BufferPool(option->gpuPageSize * 1024 * 1024);
+	for(int v=0; v < MAX_VIEWS; v++)
+		if(!batchrenderers[v])
+			batchrenderers[v] = new BatchRenderer(bufferpool);
+	if(!fragmentcounter)
+		fragmentcounter = new FragmentCounter(MAX_VIEWS);
+	if(stagingring)
+		stagingring->init();
 }
 
 int PointCloud::initPointCloud() {
@@ -81,15 +153,33 @@ int PointCloud::initPointCloud() {
     if (!lrucache)
         lrucache = new LRUCache(option->maxNodeInMem);
 
+    // negative cache of missing/empty node files
+    if (!errorcache)
+        errorcache = new LoadErrorCache(option->loadRetryDelay[0], option->loadRetryDelay[1]);
+    else
+        errorcache->clear();
+
+    // point budget, created before the root so that visibility updates can use it
+    if (!governor)
+        governor = new BudgetGovernor(option->visiblePointTarget, option->minNodePixelSize, option->pointBudgetRange[0],
+                                      option->pointBudgetRange[1], option->budgetFrameTime);
+
+    // decoded data of the last run, not used while the data changes online
+    if (!snapshot && !option->cacheSnapshot.empty() && !option->onlineUpdate) {
+        snapshot = new CacheSnapshot(option->cacheSnapshot);
+        snapshot->open(getSnapshotKey());
+    }
+
     // root node
 	string name = "r";
 	root = new NodeGeometry(name);
 	root->setInfo(pcinfo);
+	root->setErrorCache(errorcache);
     if(root->loadHierachy(lrucache)) {
 		cout << "fail to load root hierachy" << endl;
 		return -1;
 	}
-	if(root->loadData()) {
+	if(root->loadData(NULL, snapshot)) {
 		cout << "fail to load root data " << endl;
 		return -1;
 	}
@@ -97,23 +187,55 @@ int PointCloud::initPointCloud() {
     //preDisplayListSize = 0;
 
 	numLoaderThread = option->numReadThread;
+	if(!throttle)
+		throttle = new LoadThrottle(numLoaderThread, option->maxUploadsPerFrame, option->targetFrameTime,
+									option->throttleIdleTime);
+	for(int v=0; v < MAX_VIEWS; v++)
+		if(!occlusionbuffers[v] && option->occlusionBuffer[0] > 0 && option->occlusionBuffer[1] > 0)
+			occlusionbuffers[v] = new OcclusionBuffer(option->occlusionBuffer[0], option->occlusionBuffer[1]);
+	if(!predictor)
+		predictor = new CameraPredictor();
+	if(!stagingring && option->stagingRing[0] > 0)
+		stagingring = new StagingRing(option->stagingRing[0], option->stagingRing[1] * 1024 * 1024);
 	// reading threads
 	if(nodeLoaderThreads.size() == 0) {
     	for(int i = 0; i < numLoaderThread; i++) {
-    		NodeLoaderThread* t = new NodeLoaderThread(nodeQueue, option->maxLoadSize);
+    		NodeLoaderThread* t = new NodeLoaderThread(nodeQueue, option->maxLoadSize, throttle, stagingring, snapshot);
     		t->start();
     		nodeLoaderThreads.push_back(t);
 	    }
 	
     }
 
-    preloadUpToLevel(option->preloadToLevel);
+    // the hottest nodes of earlier sessions are loaded in the background instead of the top levels
+    warmupNames.clear();
+    warmupNodes.clear();
+    warmupNext = 0;
+    warmupBytes = 0;
+    if (!heatmap && !option->accessHeatmap.empty()) {
+        heatmap = new AccessHeatmap(option->accessHeatmap);
+        heatmap->load();
+    }
+    if (heatmap)
+        heatmap->getHottest(warmupNames, option->maxNodeInMem / 2);
+    lastDisplayTime = Utils::getTime();
+    if (!warmupNames.empty())
+        needPrefetch = true;
+    if (snapshot && snapshot->getNumNodes() > 0)
+        restoreSnapshot();
+    else if (warmupNames.empty())
+        preloadUpToLevel(option->preloadToLevel);
+    traversal.reset();
+    needTraversal = true;
 
 	return 1;
 }
 
 
 
+// the hierarchy is read here, level by level up to level within visiblePointTarget points, and the
+// data loads of its nodes are queued to the loader threads. Blocks until they are done unless
+// preloadAsync is set, then updatePreload reports the progress while rendering starts.
 int PointCloud::preloadUpToLevel(const int level) {
 	priority_queue<NodeWeight> priority_queue;
 	priority_queue.push(NodeWeight(root, 1));
@@ -121,6 +243,8 @@ int PointCloud::preloadUpToLevel(const int level) {
 	unsigned numloaded = 0;
 
 	cout << "Preload data to tree level " << level << " ..." << endl;
+	preloadNodes.clear();
+	preloadStart = Utils::getTime();
 
 	while(priority_queue.size() > 0) {
 
@@ -133,10 +257,15 @@ int PointCloud::preloadUpToLevel(const int level) {
 
     	if(!canload)
     		continue;
+        numloaded += node->getNumPoints();
 
         node->loadHierachy(lrucache);
-		node->loadData();
 		lrucache->insert(node->getName(), node);
+		if(!node->inQueue() && node->canAddToQueue()) {
+			node->setState(STATE_INQUEUE);
+			nodeQueue.add(node);
+			preloadNodes.push_back(node);
+		}
 
 		if(node->getLevel() >= level)
 			continue;
@@ -149,27 +278,288 @@ int PointCloud::preloadUpToLevel(const int level) {
 
 	}
 
+	if(option->preloadAsync)
+		return 0;
+	while(!updatePreload())
+		usleep(PRELOAD_POLL_INTERVAL);
 	return 0;
 }
 
+// the nodes of the snapshot are queued in the order they were saved, visible ones first, and
+// the loader threads restore them. Blocks like preloadUpToLevel unless preloadAsync is set.
+void PointCloud::restoreSnapshot() {
+	const vector<string>& names = snapshot->getNames();
+	cout << "Restore " << names.size() << " nodes from the cache snapshot ..." << endl;
+	preloadNodes.clear();
+	preloadStart = Utils::getTime();
+	for(int i=0; i < names.size(); i++) {
+		NodeGeometry* node = findNode(names[i]);
+		if(!node)
+			continue;
+		lrucache->insert(node->getName(), node);
+		if(!node->inQueue() && node->canAddToQueue()) {
+			node->setState(STATE_INQUEUE);
+			nodeQueue.add(node);
+			preloadNodes.push_back(node);
+		}
+	}
+
+	if(option->preloadAsync)
+		return;
+	while(!updatePreload())
+		usleep(PRELOAD_POLL_INTERVAL);
+}
+
+// size and modification time of a file, empty if it does not exist
+static string getFileStamp(const string& filename) {
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0)
+		return "";
+	stringstream ss;
+	ss << st.st_size << "@" << st.st_mtime;
+	return ss.str();
+}
+
+// a snapshot of other data or another potree conversion is not used, a conversion with the
+// same parameters is told apart by the stamps of cloud.js and the root hierarchy
+string PointCloud::getSnapshotKey() {
+	stringstream ss;
+	ss << pcinfo->version << " " << pcinfo->dataDir << pcinfo->octreeDir << " " << pcinfo->spacing << " "
+	   << pcinfo->scale << " " << pcinfo->hierarchyStepSize << " " << pcinfo->pointByteSize;
+	for(int i=0; i < 6; i++)
+		ss << " " << pcinfo->boundingBox[i];
+	ss << " " << getFileStamp(option->dataDir + "cloud.js")
+	   << " " << getFileStamp(pcinfo->dataDir + pcinfo->octreeDir + "/r/r.hrc");
+	return ss.str();
+}
+
+bool PointCloud::saveSnapshot() {
+	if(!snapshot || !root)
+		return false;
+	vector<NodeGeometry*> nodes(drawList.begin(), drawList.end());
+	vector<NodeGeometry*> cached;
+	lrucache->getValues(cached);
+	set<NodeGeometry*> visible(drawList.begin(), drawList.end());
+	for(int i=0; i < cached.size(); i++)
+		if(visible.find(cached[i]) == visible.end())
+			nodes.push_back(cached[i]);
+	return CacheSnapshot::save(option->cacheSnapshot, getSnapshotKey(), nodes, option->snapshotMemory * 1024.0 * 1024.0);
+}
+
+// reports the preload progress, true once none of its nodes is queued or loading any more
+// (loaded, failed or already evicted)
+bool PointCloud::updatePreload() {
+	if(preloadNodes.empty())
+		return true;
+	int done = 0;
+	for(int i=0; i < preloadNodes.size(); i++)
+		if(!preloadNodes[i]->inQueue() && !preloadNodes[i]->isLoading())
+			done++;
+	int total = preloadNodes.size();
+	if(done != preloadDone) {
+		preloadDone = done;
+		if(preloadCallback)
+			preloadCallback(done, total, preloadCallbackData);
+	}
+	if(done < total)
+		return false;
+	cout << "Preloaded " << total << " nodes in " << Utils::getTime() - preloadStart << " ms" << endl;
+	preloadNodes.clear();
+	preloadDone = 0;
+	return true;
+}
 
-int PointCloud::updateVisibility(const float MVP[16], const float campos[3], const int width, const int height) {
-    if (pauseUpdate)
-        return 0;
 
+// pixels per world unit at the point of the node's bounding sphere nearest to the camera.
+// Uses the actual projection and viewport: pixelscale is the length of the second row
+// of MVP times half the viewport height. FLT_MAX when the camera is inside the sphere.
+static float getPixelsPerUnit(const float MVP[16], const float pixelscale, NodeGeometry* node) {
+	float* c = node->getSphereCentre();
+	float w = MVP[3]*c[0] + MVP[7]*c[1] + MVP[11]*c[2] + MVP[15];
+	w -= node->getSphereRadius() * sqrt(MVP[3]*MVP[3] + MVP[7]*MVP[7] + MVP[11]*MVP[11]);
+	if(w <= 0)
+		return FLT_MAX;
+	return pixelscale / w;
+}
+
+// potree halves the point spacing with every level
+static float getSpacing(NodeGeometry* node) {
+	return node->getInfo()->spacing / (float)(1 << node->getLevel());
+}
+
+// points of a node are stored in random order, so any prefix is a uniform subsample.
+// Draw only as many as needed to cover the projected node at pointDensity points per pixel.
+unsigned int PointCloud::getDrawCount(NodeGeometry* node, const float pixelradius, const float weight) {
+	unsigned int count = node->getNumPoints();
+	if(option->pointDensity <= 0 || pixelradius == FLT_MAX)
+		return count;
+	float needed = ceil(PI * pixelradius * pixelradius * option->pointDensity * weight);
+	if(needed < count)
+		count = needed > 1 ? needed : 1;
+	return count;
+}
+
+// LOD weight of a node by the angle between the gaze and the nearest point of its bounding sphere:
+// 1 within the inner angle, the periphery weight beyond the outer angle, linear in between
+float PointCloud::getGazeWeight(NodeGeometry* node) {
+	const TraversalState& state = traversal.state;
+	if(!state.gaze)
+		return 1;
+	float* c = node->getSphereCentre();
+	float d[3] = { c[0] - state.gazeorigin[0], c[1] - state.gazeorigin[1], c[2] - state.gazeorigin[2] };
+	float dist = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+	float r = node->getSphereRadius();
+	if(dist <= r)
+		return 1;
+	float cosangle = (d[0]*state.gazedir[0] + d[1]*state.gazedir[1] + d[2]*state.gazedir[2]) / dist;
+	cosangle = cosangle > 1 ? 1 : (cosangle < -1 ? -1 : cosangle);
+	float angle = (acos(cosangle) - asin(r / dist)) * 180.0f / PI;
+	float inner = state.gazefalloff[0], outer = state.gazefalloff[1], weight = state.gazefalloff[2];
+	if(angle <= inner)
+		return 1;
+	if(angle >= outer || outer <= inner)
+		return weight;
+	return 1 - (1 - weight) * (angle - inner) / (outer - inner);
+}
+
+void PointCloud::setGaze(const float origin[3], const float direction[3]) {
+	float len = sqrt(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+	if(len == 0) {
+		gazeEnabled = false;
+		return;
+	}
+	for(int i=0; i < 3; i++) {
+		gazeOrigin[i] = origin[i];
+		gazeDirection[i] = direction[i] / len;
+	}
+	gazeEnabled = true;
+}
+
+int PointCloud::updateVisibility(const float MVP[16], const float campos[3], const int width, const int height) {
 	this->width = width;
 	this->height = height;
+	View view(MVP, campos, width, height);
+	return updateVisibility(&view, 1);
+}
 
-	float V[6][4];
-    Utils::getFrustum(V, MVP);
-	    
-    displayList.clear();
-    numVisibleNodes = 0;
-    numVisiblePoints = 0;
+int PointCloud::updateVisibility(const View* views, int numviews) {
+    newFrame = true;
+    if (pauseUpdate)
+        return 0;
+
+	if(numviews > MAX_VIEWS) {
+		// the views beyond are not traversed, their contexts draw the nodes of the first view
+		if(!warnedViews)
+			cout << "warning: " << numviews << " views in one process, only " << MAX_VIEWS << " are culled" << endl;
+		warnedViews = true;
+		numviews = MAX_VIEWS;
+	}
+	if(numviews < 1)
+		return 1;
+
+	for(int v=0; v < numviews; v++) {
+		for(int i=0; i < 16; i++) {
+			if(lastMVP[v][i] != views[v].MVP[i]) {
+				cameraMoved = true;
+				lastMVP[v][i] = views[v].MVP[i];
+			}
+		}
+	}
 
-    unsigned int start_time = Utils::getTime();
     if (!root)
         return 1;
+
+    addedNodes.clear();
+    removedNodes.clear();
+    predictor->frame(views[0].MVP, views[0].campos);
+    updatePreload();
+    updateTour();
+
+    if (!traversal.active) {
+        if (hierarchyRetryTime > 0 && Utils::getTime() >= hierarchyRetryTime)
+            needTraversal = true;
+
+        TraversalState state;
+        state.numViews = numviews;
+        for(int v=0; v < numviews; v++)
+            state.views[v] = views[v];
+        state.pointbudget = governor->getPointBudget();
+        state.minpixelsize = governor->getMinNodePixelSize();
+        state.lodthreshold = option->lodPixelThreshold;
+        state.pointdensity = option->pointDensity;
+        state.sortnodes = option->sortNodes;
+        state.lodhysteresis = option->lodHysteresis > 0 && option->lodHysteresis < 1 ? option->lodHysteresis : 1;
+        state.gaze = gazeEnabled;
+        for(int i=0; i < 3; i++) {
+            state.gazeorigin[i] = gazeOrigin[i];
+            state.gazedir[i] = gazeDirection[i];
+            state.gazefalloff[i] = option->gazeFalloff[i];
+        }
+
+        // the result would be the same as last time, only retry the loads still missing
+        if (!needTraversal && !option->onlineUpdate && state == lastTraversal) {
+            updatePendingNodes();
+            updateResidentNodes();
+            if (needPrefetch)
+                prefetch(views[0]);
+            numSkippedTraversals++;
+            return 0;
+        }
+        startTraversal(state);
+    }
+
+    // out of time, the last complete display list is drawn meanwhile.
+    // A traversal finishes with the views it started with even if the camera moved.
+    if (!continueTraversal()) {
+        updatePendingNodes();
+        return 0;
+    }
+    finishTraversal(views[0].campos);
+    prefetch(views[0]);
+    return 0;
+}
+
+// largest angle in degrees between the view directions of the same view in two traversals
+static float getViewTurn(const TraversalState& a, const TraversalState& b) {
+    float turn = 0;
+    for(int v=0; v < a.numViews && v < b.numViews; v++) {
+        const float* m = a.views[v].MVP;
+        const float* n = b.views[v].MVP;
+        float la = sqrt(m[3]*m[3] + m[7]*m[7] + m[11]*m[11]);
+        float lb = sqrt(n[3]*n[3] + n[7]*n[7] + n[11]*n[11]);
+        if(la <= 0 || lb <= 0)
+            return 180;
+        float c = (m[3]*n[3] + m[7]*n[7] + m[11]*n[11]) / (la * lb);
+        float angle = DEG(acos(c > 1 ? 1 : (c < -1 ? -1 : c)));
+        if(angle > turn)
+            turn = angle;
+    }
+    return turn;
+}
+
+void PointCloud::startTraversal(const TraversalState& state) {
+    // occluders come from the display list of the last traversal, after a fast turn they
+    // would hide nodes that just came into view
+    bool occlusion = false;
+    if (occlusionbuffers[0] && drawList.size() > 0) {
+        occlusion = state.numViews == lastTraversal.numViews && getViewTurn(lastTraversal, state) < OCCLUSION_MAX_TURN;
+        if (!occlusion)
+            numOcclusionSkipped++;
+    }
+    lastTraversal = state;
+    needTraversal = false;
+    hierarchyRetryTime = 0;
+    visibilityFrame++;
+
+    traversal.reset();
+    traversal.active = true;
+    traversal.state = state;
+    for(int v=0; v < state.numViews; v++) {
+        const float* MVP = state.views[v].MVP;
+        Utils::getFrustum(traversal.V[v], MVP);
+        traversal.pixelscale[v] = sqrt(MVP[1]*MVP[1] + MVP[5]*MVP[5] + MVP[9]*MVP[9]) * state.views[v].height * 0.5f;
+    }
+
     root->loadHierachy(lrucache);
 
     if (option->onlineUpdate) {
@@ -179,26 +569,82 @@ int PointCloud::updateVisibility(const float MVP[16], const float campos[3], con
         root->Update();
     }
 
+    // occluders are the loaded nodes of the last display list, nearest first, splatted into the
+    // buffer of every view
+    traversal.occlusion = occlusion;
+    for(int v=0; occlusion && v < state.numViews; v++) {
+        OcclusionBuffer* buffer = occlusionbuffers[v];
+        buffer->begin(state.views[v].MVP);
+        for(int i=0; i < drawList.size() && !buffer->isFull(); i++)
+            buffer->addOccluder(drawList[i], getSpacing(drawList[i]));
+        buffer->end();
+    }
 
-    priority_queue<NodeWeight> priority_queue;
-    priority_queue.push(NodeWeight(root, 1));
+    // nodes are frustum tested as children of their parent before they are queued
+    NodeWeight rootweight(root, 1, 0);
+    for(int v=0; v < state.numViews; v++) {
+        rootweight.planemask[v] = FrustumCuller::testBox(traversal.V[v], root->getBBox());
+        if(rootweight.planemask[v] != FRUSTUM_OUTSIDE)
+            rootweight.viewmask |= 1 << v;
+    }
+    if(rootweight.viewmask)
+        traversal.queue.push(rootweight);
+}
+
+// runs the traversal for traversalBudget us, true when its queue is empty.
+// A node is selected for the views whose frustum it intersects and that refined its parent,
+// its weight and draw count are the largest of those views.
+bool PointCloud::continueTraversal() {
+    unsigned long start_time = Utils::getTimeUs();
+    unsigned long maxtime = option->traversalBudget;
+    int numviews = traversal.state.numViews;
+    unsigned int pointbudget = traversal.state.pointbudget;
+    float minpixelsize = traversal.state.minpixelsize;
+    // nodes visible in the last traversal are kept and refined down to lower thresholds
+    float hysteresis = traversal.state.lodhysteresis;
+    unsigned int now = Utils::getTime();
+    bool occlusion = traversal.occlusion;
+    priority_queue<NodeWeight>& priority_queue = traversal.queue;
+    traversal.numFrames++;
+
+    float ppu[MAX_VIEWS];
+    unsigned int counts[MAX_VIEWS];
+    int masks[MAX_VIEWS][8];
 
     while(priority_queue.size() > 0){
-    	NodeGeometry* node = priority_queue.top().node;
+        if(maxtime > 0 && Utils::getTimeUs() - start_time > maxtime)
+            return false;
+
+    	NodeWeight nw = priority_queue.top();
+    	NodeGeometry* node = nw.node;
     	priority_queue.pop();
     	bool visible = false;
 
         if (option->onlineUpdate)
             node->Update();
 
-    	if(Utils::testFrustum(V, node->getBBox()) >= 0 && numVisiblePoints + node->getNumPoints() < option->visiblePointTarget)
+    	// the point budget counts drawn points, what partial nodes leave goes to more nodes.
+    	// Away from the gaze nodes are drawn with fewer points and refined later and less.
+    	float gazeweight = getGazeWeight(node);
+    	unsigned int drawcount = 0;
+    	for(int v=0; v < numviews; v++) {
+    		counts[v] = 0;
+    		if(!(nw.viewmask & (1 << v)))
+    			continue;
+    		ppu[v] = getPixelsPerUnit(traversal.state.views[v].MVP, traversal.pixelscale[v], node);
+    		float pixelradius = ppu[v] == FLT_MAX ? FLT_MAX : node->getSphereRadius() * ppu[v];
+    		counts[v] = getDrawCount(node, pixelradius, gazeweight);
+    		if(counts[v] > drawcount)
+    			drawcount = counts[v];
+    	}
+    	if(traversal.numPoints + drawcount < pointbudget)
     		visible = true;
 	    
 	    if(!visible)
 	    	continue; 
 
-	    numVisibleNodes++;
-		numVisiblePoints += node->getNumPoints();
+	    traversal.numPoints += drawcount;
+		traversal.numNodePoints += node->getNumPoints();
 
         node->loadHierachy(lrucache);
 
@@ -212,55 +658,626 @@ int PointCloud::updateVisibility(const float MVP[16], const float campos[3], con
             //cout << "adding " << node->getName() << " to queue because its dirty" << endl;
             nodeQueue.add(node);
         }		
-		displayList.push_back(node);
-		lrucache->insert(node->getName(), node);
+		// loaded ahead for a predicted view, it goes before the other prefetches if still queued
+		if(node->isPrefetched()) {
+			node->setPrefetched(false);
+			if(node->isLoaded()) {
+				numPrefetchHits++;
+			} else {
+				numPrefetchLate++;
+				nodeQueue.promote(node);
+			}
+		} else if(node->getVisibleFrame() != visibilityFrame - 1 && !node->isLoaded()) {
+			numPrefetchMisses++;
+		}
+		if(node->getVisibleFrame() != visibilityFrame - 1) {
+			traversal.added.push_back(node);
+			lrucache->pin(node->getName(), node);
+			if(node->getVisibleFrame() > 0) {
+				node->addFlip();
+				traversal.numFlips++;
+				if(node->getNumFlips() > maxFlips) {
+					maxFlips = node->getNumFlips();
+					maxFlipsNode = node->getName();
+				}
+			}
+		}
+		node->setVisibleTime(now);
+		node->setVisibleFrame(visibilityFrame, traversal.nodes.size());
+		traversal.nodes.push_back(node);
+		traversal.viewmasks.push_back(nw.viewmask);
+		traversal.counts.insert(traversal.counts.end(), counts, counts + numviews);
+
+		// children may appear once the hierarchy loads on a retry, traverse again when it is due
+		if(node->getNumHierarchyErrors() > 0) {
+			unsigned int retry = node->getHierarchyRetryTime();
+			if(hierarchyRetryTime == 0 || retry < hierarchyRetryTime)
+				hierarchyRetryTime = retry;
+		}
 
-		if(Utils::getTime() - start_time > 150)
-			return 0;
-		
-		// add children to priority_queue
+		// refine only in the views where the point spacing of the node is visible on screen.
+		// Children of a node fully inside a frustum are not tested against it.
+		float spacing = getSpacing(node) * gazeweight;
+		float threshold = traversal.state.lodthreshold;
 		for(int i=0; i < 8; i++) {
-			if(node->getChild(i) == NULL)
+			NodeGeometry* child = node->getChild(i);
+			if(child && child->getVisibleFrame() == visibilityFrame - 1) {
+				threshold *= hysteresis;
+				break;
+			}
+		}
+		int refinemask = 0;
+		for(int v=0; v < numviews; v++) {
+			if(!(nw.viewmask & (1 << v)))
 				continue;
-			//calculte weight
-			float* centre = node->getSphereCentre();
-			float radius = node->getSphereRadius();
-			float distance = Utils::distance(centre, campos);
-			float fov = 0.6;
-			float pr = 1 / tan(fov) * radius / sqrt(distance*distance - radius*radius);
-			float weight = pr;
-			if(distance - radius < 0)
-				weight = FLT_MAX;
-
-			float screenpixelradius = height * pr;
-			if(screenpixelradius < option->minNodePixelSize)
+			if(ppu[v] != FLT_MAX && spacing * ppu[v] < threshold)
 				continue;
+			refinemask |= 1 << v;
+			for(int i=0; i < 8; i++)
+				masks[v][i] = 0;
+			if(nw.planemask[v] != 0)
+				FrustumCuller::testChildren(traversal.V[v], node->getChildBounds(), nw.planemask[v], masks[v]);
+		}
+		if(refinemask == 0)
+			continue;
 
-			priority_queue.push(NodeWeight(node->getChild(i), weight));
-			//priority_queue.push(NodeWeight(node->getChild(i), 1.0/node->getChild(i)->getLevel()));
+		// add children to priority_queue, largest projected spacing first
+		for(int i=0; i < 8; i++) {
+			NodeGeometry* child = node->getChild(i);
+			if(child == NULL)
+				continue;
+			NodeWeight cw(child, 0, 0);
+			float childspacing = getSpacing(child) * getGazeWeight(child);
+			bool wasvisible = child->getVisibleFrame() == visibilityFrame - 1;
+			float minsize = wasvisible ? minpixelsize * hysteresis : minpixelsize;
+			for(int v=0; v < numviews; v++) {
+				if(!(refinemask & (1 << v)) || masks[v][i] == FRUSTUM_OUTSIDE)
+					continue;
+				float childppu = getPixelsPerUnit(traversal.state.views[v].MVP, traversal.pixelscale[v], child);
+				if(childppu != FLT_MAX && child->getSphereRadius() * childppu < minsize)
+					continue;
+				float weight = childppu == FLT_MAX ? FLT_MAX : childspacing * childppu;
+				if(weight > cw.weight)
+					cw.weight = weight;
+				cw.planemask[v] = masks[v][i];
+				cw.viewmask |= 1 << v;
+			}
+			if(cw.viewmask == 0)
+				continue;
+			if(wasvisible && cw.weight != FLT_MAX)
+				cw.weight /= hysteresis;
+			if(occlusion && isOccluded(cw.viewmask, child->getTightBBox()))
+				continue;
+			priority_queue.push(cw);
 		}
 
     }
+    return true;
+}
 
-    return 0;
+// a node is only culled when it is hidden in every view that sees it
+bool PointCloud::isOccluded(int viewmask, const float bbox[6]) {
+    for(int v=0; v < traversal.state.numViews; v++)
+        if((viewmask & (1 << v)) && !occlusionbuffers[v]->isOccluded(bbox))
+            return false;
+    return true;
+}
+
+// the built list becomes the display list and is split into the draw lists of the views
+void PointCloud::finishTraversal(const float campos[3]) {
+    recordAccess();
+    displayList.assign(traversal.nodes.begin(), traversal.nodes.end());
+    numVisibleNodes = traversal.nodes.size();
+    numVisiblePoints = traversal.numPoints;
+    numNodePoints = traversal.numNodePoints;
+    lastTraversalFrames = traversal.numFrames;
+    numTraversals++;
+
+    addedNodes.swap(traversal.added);
+    numFlips = traversal.numFlips;
+    totalFlips += numFlips;
+    updateVisibleSet();
+    sortDrawList(campos);
+
+    // all views are drawn in one order. Their View::campos is the camera position of the
+    // process, the same for every eye and tile, so sorting each view would give the same order.
+    numViews = traversal.state.numViews;
+    for(int v=0; v < numViews; v++) {
+        viewLists[v].clear();
+        viewLists[v].reserve(drawList.size());
+        for(int i=0; i < drawList.size(); i++) {
+            int index = drawList[i]->getVisibleIndex();
+            if(traversal.viewmasks[index] & (1 << v))
+                viewLists[v].push_back(DrawItem(drawList[i], traversal.counts[index * numViews + v]));
+        }
+    }
+    traversal.reset();
+    drawListChanged = true;
+}
+
+// a single view traversal with the LOD of the last visible one scaled by lodscale, appending the
+// nodes it selects within pointbudget to selected. Nodes that intersect the exclude frustum are
+// refined but neither selected nor counted.
+void PointCloud::selectNodes(const View& view, float V[6][4], unsigned int pointbudget, float lodscale,
+                             float (*exclude)[4], unsigned long deadline, vector<NodeGeometry*>& selected) {
+    float minpixelsize = lastTraversal.minpixelsize * lodscale;
+    float lodthreshold = lastTraversal.lodthreshold * lodscale;
+    const float* MVP = view.MVP;
+    float pixelscale = sqrt(MVP[1]*MVP[1] + MVP[5]*MVP[5] + MVP[9]*MVP[9]) * view.height * 0.5f;
+
+    unsigned int numpoints = 0;
+    priority_queue<NodeWeight> queue;
+    NodeWeight rootweight(root, 1);
+    rootweight.planemask[0] = FrustumCuller::testBox(V, root->getBBox());
+    if (rootweight.planemask[0] != FRUSTUM_OUTSIDE)
+        queue.push(rootweight);
+    int masks[8];
+
+    while (queue.size() > 0) {
+        if (deadline > 0 && Utils::getTimeUs() > deadline)
+            break;
+        NodeWeight nw = queue.top();
+        NodeGeometry* node = nw.node;
+        queue.pop();
+
+        float ppu = getPixelsPerUnit(MVP, pixelscale, node);
+        if (!exclude || FrustumCuller::testBox(exclude, node->getBBox()) == FRUSTUM_OUTSIDE) {
+            float pixelradius = ppu == FLT_MAX ? FLT_MAX : node->getSphereRadius() * ppu;
+            unsigned int drawcount = getDrawCount(node, pixelradius);
+            if (numpoints + drawcount >= pointbudget)
+                continue;
+            numpoints += drawcount;
+            selected.push_back(node);
+        }
+        node->loadHierachy(lrucache);
+
+        if (ppu != FLT_MAX && getSpacing(node) * ppu < lodthreshold)
+            continue;
+        for (int i=0; i < 8; i++)
+            masks[i] = 0;
+        if (nw.planemask[0] != 0)
+            FrustumCuller::testChildren(V, node->getChildBounds(), nw.planemask[0], masks);
+        for (int i=0; i < 8; i++) {
+            NodeGeometry* child = node->getChild(i);
+            if (child == NULL || masks[i] == FRUSTUM_OUTSIDE)
+                continue;
+            float childppu = getPixelsPerUnit(MVP, pixelscale, child);
+            if (childppu != FLT_MAX && child->getSphereRadius() * childppu < minpixelsize)
+                continue;
+            NodeWeight cw(child, childppu == FLT_MAX ? FLT_MAX : getSpacing(child) * childppu);
+            cw.planemask[0] = masks[i];
+            queue.push(cw);
+        }
+    }
+}
+
+// frustum of view widened by angle degrees on every side and moved out by margin at near and far
+static void getGuardFrustum(const View& view, float angle, float margin, float V[6][4]) {
+    float MVP[16];
+    for (int i=0; i < 16; i++)
+        MVP[i] = view.MVP[i];
+    // the w row has unit length for a rigid view, so the tangent of a half field of view is |w| / |x|
+    float w = sqrt(MVP[3]*MVP[3] + MVP[7]*MVP[7] + MVP[11]*MVP[11]);
+    for (int r=0; r < 2; r++) {
+        float len = sqrt(MVP[r]*MVP[r] + MVP[4+r]*MVP[4+r] + MVP[8+r]*MVP[8+r]);
+        if (len <= 0)
+            continue;
+        float half = atan(w / len) + RAD(angle);
+        if (half > RAD(89))
+            half = RAD(89);
+        float scale = w / len / tan(half);
+        for (int c=0; c < 4; c++)
+            MVP[c*4 + r] *= scale;
+    }
+    Utils::getFrustum(V, MVP);
+    V[4][3] += margin;
+    V[5][3] += margin;
+}
+
+// after a complete traversal, nodes that are likely to become visible are loaded behind the
+// visible ones in the low priority lane of the loader queue, in this order:
+// - the selection of a traversal against the view extrapolated prefetchTime ahead, with the LOD
+//   and point budget of the visible one
+// - the nodes of the upcoming keyframes of a tour, in time order
+// - the nodes in the guard band around the frustum of every view, at a lower LOD and within
+//   their own point budget shared by the views
+// - the hottest nodes of earlier sessions, until they are loaded
+// Queued nodes that are no longer selected are dropped.
+void PointCloud::prefetch(const View& view) {
+    needPrefetch = false;
+    unsigned long deadline = option->traversalBudget > 0 ? Utils::getTimeUs() + option->traversalBudget : 0;
+    vector<NodeGeometry*> selected;
+
+    View predicted(view.MVP, view.campos, view.width, view.height);
+    if (option->prefetchTime > 0 && predictor->predict(option->prefetchTime, predicted.MVP, predicted.campos)) {
+        float V[6][4];
+        Utils::getFrustum(V, predicted.MVP);
+        selectNodes(predicted, V, lastTraversal.pointbudget, 1, NULL, deadline, selected);
+    }
+
+    int numpredicted = selected.size();
+    addTourNodes(deadline, selected);
+    numTourNodes = selected.size() - numpredicted;
+
+    numpredicted = selected.size();
+    if (option->guardBand[0] > 0 && option->guardBand[2] > 0) {
+        // the edges of every eye and tile are guarded, each with an equal share of the budget
+        unsigned int budget = option->guardBand[2] / lastTraversal.numViews;
+        for (int v=0; v < lastTraversal.numViews; v++) {
+            const View& guarded = lastTraversal.views[v];
+            float V[6][4], G[6][4];
+            Utils::getFrustum(V, guarded.MVP);
+            getGuardFrustum(guarded, option->guardBand[0], option->guardBand[1], G);
+            selectNodes(guarded, G, budget, option->guardBand[3] > 1 ? option->guardBand[3] : 1,
+                        V, deadline, selected);
+        }
+    }
+    numGuardNodes = selected.size() - numpredicted;
+    addWarmupNodes(deadline, selected);
+
+    if (selected.size() == 0)
+        return;
+
+    // requeue in the new priority order
+    list<NodeGeometry*> queued;
+    nodeQueue.takeLow(queued);
+    prefetchFrame++;
+    for (int i=0; i < selected.size(); i++) {
+        NodeGeometry* node = selected[i];
+        if (node->getPrefetchFrame() == prefetchFrame)
+            continue;
+        node->setPrefetchFrame(prefetchFrame);
+        if (node->inQueue() && node->isPrefetched()) {
+            nodeQueue.addLow(node);
+        } else if (!node->inQueue() && node->canAddToQueue()) {
+            node->setState(STATE_INQUEUE);
+            node->setPrefetched(true);
+            // evictable until it becomes visible
+            lrucache->insert(node->getName(), node);
+            nodeQueue.addLow(node);
+            numPrefetched++;
+        }
+    }
+    for (list<NodeGeometry*>::iterator it = queued.begin(); it != queued.end(); it++) {
+        NodeGeometry* node = *it;
+        if (node->getPrefetchFrame() == prefetchFrame)
+            continue;
+        node->setState(STATE_NONE);
+        node->setPrefetched(false);
+        numPrefetchCancelled++;
+    }
+}
+
+// appends the nodes of the keyframes not passed yet, nearest first, as long as their data fits
+// in tourMemory. Keyframe selections run once, those over the deadline in a later prefetch.
+void PointCloud::addTourNodes(unsigned long deadline, vector<NodeGeometry*>& selected) {
+    double budget = option->tourMemory * 1024.0 * 1024.0;
+    double bytes = 0;
+    set<NodeGeometry*> added;
+    for (int k=tourNext; k < tour.size(); k++) {
+        TourKeyframe& key = tour[k];
+        if (!key.selected) {
+            if (deadline > 0 && Utils::getTimeUs() > deadline) {
+                needPrefetch = true;
+                return;
+            }
+            float V[6][4];
+            Utils::getFrustum(V, key.view.MVP);
+            selectNodes(key.view, V, lastTraversal.pointbudget, 1, NULL, 0, key.nodes);
+            key.selected = true;
+        }
+        for (int i=0; i < key.nodes.size(); i++) {
+            NodeGeometry* node = key.nodes[i];
+            if (!added.insert(node).second)
+                continue;
+            bytes += (double)node->getNumPoints() * (POOL_VERTEX_SIZE + POOL_COLOR_SIZE);
+            if (bytes > budget)
+                return;
+            selected.push_back(node);
+        }
+    }
+}
+
+// appends the hottest nodes of earlier sessions that are not loaded yet, as long as all of them fit
+// in warmupMemory. Names are resolved to nodes, loading the hierarchy on their path, until the deadline.
+void PointCloud::addWarmupNodes(unsigned long deadline, vector<NodeGeometry*>& selected) {
+    double budget = option->warmupMemory * 1024.0 * 1024.0;
+    while (warmupNext < warmupNames.size() && warmupBytes < budget) {
+        if (deadline > 0 && Utils::getTimeUs() > deadline) {
+            needPrefetch = true;
+            break;
+        }
+        NodeGeometry* node = findNode(warmupNames[warmupNext++]);
+        if (!node)
+            continue;
+        warmupBytes += (double)node->getNumPoints() * (POOL_VERTEX_SIZE + POOL_COLOR_SIZE);
+        if (warmupBytes > budget)
+            break;
+        warmupNodes.push_back(node);
+    }
+
+    int n = 0;
+    for (int i=0; i < warmupNodes.size(); i++) {
+        NodeGeometry* node = warmupNodes[i];
+        if (node->isLoaded() || node->getNumLoadErrors() > 0)
+            continue;
+        warmupNodes[n++] = node;
+        selected.push_back(node);
+    }
+    warmupNodes.resize(n);
+}
+
+// the node of a potree name ("r" followed by child indices), NULL if the hierarchy has no such node
+NodeGeometry* PointCloud::findNode(const string& name) {
+    if (name.empty() || name[0] != 'r')
+        return NULL;
+    NodeGeometry* node = root;
+    for (int i=1; node && i < name.size(); i++) {
+        node->loadHierachy(lrucache);
+        int c = name[i] - '0';
+        if (c < 0 || c > 7)
+            return NULL;
+        node = node->getChild(c);
+    }
+    return node;
+}
+
+// the last display list was on screen since the last traversal finished
+void PointCloud::recordAccess() {
+    if (!heatmap)
+        return;
+    unsigned int now = Utils::getTime();
+    float ms = now - lastDisplayTime;
+    for (int i=0; i < drawList.size(); i++)
+        heatmap->add(drawList[i]->getName(), ms);
+    lastDisplayTime = now;
+    if (master)
+        heatmap->saveEvery(HEATMAP_SAVE_INTERVAL);
+}
+
+// keyframes whose time has come are passed, their nodes should be loaded by then
+void PointCloud::updateTour() {
+    if (!tourStarted)
+        return;
+    float elapsed = (Utils::getTime() - tourStart) / 1000.0f;
+    while (tourNext < tour.size() && tour[tourNext].time <= elapsed) {
+        TourKeyframe& key = tour[tourNext];
+        int missing = 0;
+        for (int i=0; i < key.nodes.size(); i++)
+            if (!key.nodes[i]->isLoaded())
+                missing++;
+        if (missing > 0 || !key.selected) {
+            numTourStalls++;
+            numTourMissing += missing;
+        }
+        tourNext++;
+        needPrefetch = true;
+    }
+}
+
+void PointCloud::addTourKeyframe(float time, const View& view) {
+    int k = tour.size();
+    while (k > 0 && tour[k-1].time > time)
+        k--;
+    tour.insert(tour.begin() + k, TourKeyframe(time, view));
+    needPrefetch = true;
+}
+
+void PointCloud::startTour() {
+    tourStarted = true;
+    tourStart = Utils::getTime();
+    tourNext = 0;
+    numTourStalls = 0;
+    numTourMissing = 0;
+    needPrefetch = true;
+}
+
+void PointCloud::clearTour() {
+    tour.clear();
+    tourStarted = false;
+    tourNext = 0;
+    numTourNodes = 0;
+}
+
+// every keyframe needs the data of its nodes and those of the keyframes before it that are not
+// loaded yet, at the I/O rate measured so far
+bool PointCloud::checkTour() {
+    float rate = throttle->getLoadRate();
+    float elapsed = tourStarted ? (Utils::getTime() - tourStart) / 1000.0f : 0;
+    bool stall = false;
+    double points = 0;
+    set<NodeGeometry*> counted;
+    cout << "tour: " << tour.size() << " keyframes, " << tourNext << " passed, load rate: " << rate << " points/s" << endl;
+    for (int k=tourNext; k < tour.size(); k++) {
+        TourKeyframe& key = tour[k];
+        if (!key.selected) {
+            float V[6][4];
+            Utils::getFrustum(V, key.view.MVP);
+            selectNodes(key.view, V, lastTraversal.pointbudget, 1, NULL, 0, key.nodes);
+            key.selected = true;
+        }
+        int missing = 0;
+        for (int i=0; i < key.nodes.size(); i++) {
+            NodeGeometry* node = key.nodes[i];
+            if (node->isLoaded() || !counted.insert(node).second)
+                continue;
+            points += node->getNumPoints();
+            missing++;
+        }
+        float needed = rate > 0 ? points / rate : (points > 0 ? FLT_MAX : 0);
+        float available = key.time - elapsed;
+        cout << "  keyframe " << k << " at " << key.time << " s: " << key.nodes.size() << " nodes, " << missing
+             << " to load, ready in " << needed << " s";
+        if (needed > available) {
+            stall = true;
+            cout << " STALL (" << needed - available << " s late)";
+        }
+        cout << endl;
+    }
+    cout << "tour " << (stall ? "will stall" : "will not stall") << ", stalls so far: " << numTourStalls << " ("
+         << numTourMissing << " nodes missing)" << endl;
+    return stall;
+}
+
+// drops the queued prefetches
+void PointCloud::cancelPrefetch() {
+    list<NodeGeometry*> queued;
+    nodeQueue.takeLow(queued);
+    for (list<NodeGeometry*>::iterator it = queued.begin(); it != queued.end(); it++) {
+        (*it)->setState(STATE_NONE);
+        (*it)->setPrefetched(false);
+    }
+}
+
+// nodes of the last traversal that are no longer visible, and the visible
+// nodes still waiting for their data
+void PointCloud::updateVisibleSet() {
+	// nodes that left stay resident for minResidency, they are removed after that
+	for(int i=0; i < drawList.size(); i++) {
+		NodeGeometry* node = drawList[i];
+		if(node->getVisibleFrame() != visibilityFrame)
+			residentNodes.push_back(node);
+	}
+	updateResidentNodes();
+
+	int n = 0;
+	for(int i=0; i < pendingNodes.size(); i++) {
+		NodeGeometry* node = pendingNodes[i];
+		if(node->getVisibleFrame() == visibilityFrame && !node->hasVBO())
+			pendingNodes[n++] = node;
+	}
+	pendingNodes.resize(n);
+	for(int i=0; i < addedNodes.size(); i++) {
+		if(!addedNodes[i]->hasVBO())
+			pendingNodes.push_back(addedNodes[i]);
+	}
+}
+
+// resident nodes that became visible again or whose residency expired leave the list
+void PointCloud::updateResidentNodes() {
+	unsigned int now = Utils::getTime();
+	int n = 0;
+	for(int i=0; i < residentNodes.size(); i++) {
+		NodeGeometry* node = residentNodes[i];
+		if(node->getVisibleFrame() == visibilityFrame)
+			continue;
+		if(now - node->getVisibleTime() < option->minResidency) {
+			residentNodes[n++] = node;
+			continue;
+		}
+		removedNodes.push_back(node);
+		lrucache->unpin(node->getName());
+	}
+	residentNodes.resize(n);
+}
+
+// queue the pending nodes whose loads failed and can be retried
+void PointCloud::updatePendingNodes() {
+	for(int i=0; i < pendingNodes.size(); i++) {
+		NodeGeometry* node = pendingNodes[i];
+		if(!node->inQueue() && node->canAddToQueue()) {
+			node->setState(STATE_INQUEUE);
+			nodeQueue.add(node);
+		}
+	}
+}
+
+// front to back order of the display list for early depth rejection. Nodes that
+// stay visible keep last frame's order, which is nearly sorted while the camera
+// moves smoothly, and the added nodes are sorted into it.
+void PointCloud::sortDrawList(const float campos[3]) {
+	vector<pair<float, NodeGeometry*> > order;
+	order.reserve(displayList.size());
+	if(!option->sortNodes) {
+		for(list<NodeGeometry*>::iterator it = displayList.begin(); it != displayList.end(); it++)
+			order.push_back(make_pair(0.0f, *it));
+	} else {
+		for(int i=0; i < drawList.size(); i++) {
+			if(drawList[i]->getVisibleFrame() == visibilityFrame)
+				order.push_back(make_pair(0.0f, drawList[i]));
+		}
+		for(int i=0; i < addedNodes.size(); i++)
+			order.push_back(make_pair(0.0f, addedNodes[i]));
+
+		int n = order.size();
+		for(int i=0; i < n; i++) {
+			NodeGeometry* node = order[i].second;
+			float d = Utils::distance(node->getSphereCentre(), campos) - node->getSphereRadius();
+			order[i].first = d > 0 ? d : 0;
+		}
+		// insertion sort, a full sort when the camera turned and the order changed a lot
+		int moves = 0;
+		for(int i=1; i < n && moves <= 8*n; i++) {
+			pair<float, NodeGeometry*> item = order[i];
+			int j = i-1;
+			for(; j >= 0 && order[j].first > item.first; j--, moves++)
+				order[j+1] = order[j];
+			order[j+1] = item;
+		}
+		if(moves > 8*n)
+			sort(order.begin(), order.end());
+	}
+
+	drawList.resize(order.size());
+	for(int i=0; i < order.size(); i++)
+		drawList[i] = order[i].second;
+}
+
+void PointCloud::updateFrameTime(const float frametime) {
+	if(!throttle)
+		return;
+	throttle->setTargetFrameTime(option->targetFrameTime);
+	throttle->frame(frametime, cameraMoved);
+
+	// both loops hold one frame time, that of the throttle when it is on, and the point budget
+	// is not raised while the throttle cuts loads, so they do not work against each other
+	float target = option->budgetFrameTime;
+	if(target > 0 && option->targetFrameTime > 0)
+		target = option->targetFrameTime;
+	governor->setBase(option->visiblePointTarget, option->minNodePixelSize, option->pointBudgetRange[0],
+					  option->pointBudgetRange[1]);
+	governor->setTargetFrameTime(target);
+	governor->frame(frametime, throttle->getLevel() >= 1);
+	cameraMoved = false;
 }
 
 void PointCloud::unload() {
     cout << "unloading everything" << endl;
+    cancelPrefetch();
+    preloadNodes.clear();
+    warmupNodes.clear();
+    warmupNames.clear();
     lrucache->clear();
     root = NULL;
     displayList.clear();
+    drawList.clear();
+    for(int v=0; v < MAX_VIEWS; v++)
+        viewLists[v].clear();
+    numViews = 0;
+    addedNodes.clear();
+    removedNodes.clear();
+    pendingNodes.clear();
+    residentNodes.clear();
+    for(int k=0; k < tour.size(); k++) {
+        tour[k].nodes.clear();
+        tour[k].selected = false;
+    }
+    traversal.reset();
+    needTraversal = true;
+    drawListChanged = true;
     _unload=false;
 }
 
 void PointCloud::resetRootHierarchy() {
     root->loadHierachy(lrucache, true);
+    needTraversal = true;
 }
 
 void PointCloud::flagNodeAsDirty(const std::string &nodename)
 {
     NodeGeometry * node=NULL;
     bool exist = lrucache->tryGet(nodename, node);
+    needTraversal = true;
     
     if (exist) {
         assert(node);
@@ -285,6 +1302,7 @@ void PointCloud::flagNodeAsDirty(const std::string &nodename)
 void PointCloud::reload() {
     render = false;
     pauseUpdate=true;
+    cancelPrefetch();
     //empty loading queue
     if (0!=nodeQueue.size())
     {
@@ -294,6 +1312,20 @@ void PointCloud::reload() {
     //empty lru
     lrucache->clear();
     displayList.clear();
+    drawList.clear();
+    for(int v=0; v < MAX_VIEWS; v++)
+        viewLists[v].clear();
+    numViews = 0;
+    addedNodes.clear();
+    removedNodes.clear();
+    pendingNodes.clear();
+    residentNodes.clear();
+    for(int k=0; k < tour.size(); k++) {
+        tour[k].nodes.clear();
+        tour[k].selected = false;
+    }
+    traversal.reset();
+    drawListChanged = true;
     //redo init
     initPointCloud();
     needReloadShader = true;
@@ -305,7 +1337,63 @@ void PointCloud::reload() {
 void PointCloud::debug() {
     Utils::printPCInfo(root->getInfo());
     cout << "numVisibleNodes: " << numVisibleNodes << " numVisiblePoints: " << numVisiblePoints <<
-            " nodeQueue size: " << nodeQueue.size() << " lrucache size: " << lrucache->size() << endl;
+            " (of " << numNodePoints << " in visible nodes)" <<
+            " nodeQueue size: " << nodeQueue.size() << " lrucache size: " << lrucache->size() <<
+            " (" << lrucache->numPinned() << " pinned)" << endl;
+    cout << "traversals: " << numTraversals << " skipped: " << numSkippedTraversals << " added: " << addedNodes.size() <<
+            " removed: " << removedNodes.size() << " pending: " << pendingNodes.size() <<
+            " last over " << lastTraversalFrames << " frames, " << numViews << " views";
+    if(traversal.active)
+        cout << " (running for " << traversal.numFrames << " frames, " << traversal.queue.size() << " queued)";
+    cout << endl;
+    cout << "flips: " << numFlips << " last traversal, " << totalFlips << " total, most: " << maxFlips;
+    if(maxFlips > 0)
+        cout << " (" << maxFlipsNode << ")";
+    cout << " resident: " << residentNodes.size() << " evicted: " << lrucache->numEvicted() << " ("
+         << lrucache->numEvictedUndrawn() << " loaded but never drawn)" << endl;
+    cout << "prefetch: " << option->prefetchTime << " ms ahead, queued: " << numPrefetched << " (" << nodeQueue.sizeLow()
+         << " waiting) hits: " << numPrefetchHits << " late: " << numPrefetchLate << " misses: " << numPrefetchMisses
+         << " wasted: " << numPrefetchCancelled << " dropped from the queue, " << lrucache->numEvictedPrefetched()
+         << " evicted unseen, guard band: " << numGuardNodes << " nodes" << endl;
+    if (heatmap) {
+        heatmap->printInfo();
+        cout << "warm-up: " << warmupNext << " of " << warmupNames.size() << " hottest nodes resolved, "
+             << warmupNodes.size() << " not loaded yet, " << warmupBytes / 1024 / 1024 << " MB" << endl;
+    }
+    if (snapshot)
+        snapshot->printInfo();
+    if (tour.size() > 0)
+        cout << "tour: " << tour.size() << " keyframes, next: " << tourNext << " queued: " << numTourNodes
+             << " nodes, stalls: " << numTourStalls << " (" << numTourMissing << " nodes missing)" << endl;
+    predictor->printInfo();
+    throttle->printInfo();
+    governor->printInfo();
+    cout << "uploads: " << numUploads << " backlog: " << uploadBacklog << " upload: " << uploadMBPerFrame
+         << " MB/frame " << uploadTime << " ms" << endl;
+    if(stagingring)
+        stagingring->printInfo();
+    if(bufferpool)
+        bufferpool->printInfo();
+    if(batchrenderers[0]) {
+        cout << "submit: " << submitTime << " ms (" << (option->batchDraw ? "batched" : "per node");
+        if(option->batchDraw) {
+            for(int v=0; v < numViews; v++)
+                cout << (v > 0 ? ", " : ", view ") << v << ": " << batchrenderers[v]->getNumNodes() << " nodes in "
+                     << batchrenderers[v]->getNumDrawCalls() << " draw calls";
+        }
+        cout << ")" << endl;
+    }
+    if(fragmentcounter)
+        fragmentcounter->printInfo(option->depthPrepass);
+    for(int v=0; v < lastTraversal.numViews; v++)
+        if(occlusionbuffers[v])
+            occlusionbuffers[v]->printInfo();
+    if(occlusionbuffers[0])
+        cout << "occlusion skipped after fast turns: " << numOcclusionSkipped << " traversals" << endl;
+    if(materialPoint)
+        materialPoint->getShader()->printInfo();
+    if(errorcache->size() > 0)
+        errorcache->printSummary();
     /*
     for(map<string, NodeGeometry*>::iterator it = nodes->begin(); it != nodes->end(); it++) {
         NodeGeometry* node=(*it).second;
@@ -352,27 +1440,75 @@ void PointCloud::draw() {
 		frameBuffer->clear();
 	}
 
-	for(list<NodeGeometry*>::iterator it = displayList.begin(); it != displayList.end(); it++) {
-		NodeGeometry* node = *it;
+	if(newFrame) {
+		uploadNodes();
+		fragmentcounter->update();
+		newFrame = false;
+	}
 #ifdef STANDALONE_APP
-		node->draw(MV, MVP, materialPoint, height);
+	((MaterialPoint*)materialPoint)->updateFrameUniforms(pcinfo, height, MV, MVP);
 #else
-        node->draw(materialPoint, height);
+	((MaterialPoint*)materialPoint)->updateFrameUniforms(pcinfo, height);
 #endif
+
+	// CPU submission time of the display list, to compare batched and per node drawing
+	unsigned long submit_start = Utils::getTimeUs();
+	// the batch of a view is only rebuilt when the draw list, draw counts or uploads changed
+	if(drawView >= numViews)
+		drawView = 0;
+	if(drawListChanged) {
+		for(int v=0; v < MAX_VIEWS; v++)
+			batchDirty[v] = true;
+		drawListChanged = false;
 	}
+	if(option->batchDraw && batchDirty[drawView]) {
+		vector<DrawItem>& items = viewLists[drawView];
+		batchrenderers[drawView]->begin();
+		for(int i=0; i < items.size(); i++) {
+			items[i].node->setDrawCount(items[i].count);
+			batchrenderers[drawView]->add(items[i].node);
+		}
+		batchDirty[drawView] = false;
+	}
+	if(option->depthPrepass) {
+		GLint depthfunc;
+		glGetIntegerv(GL_DEPTH_FUNC, &depthfunc);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		((MaterialPoint*)materialPoint)->setDepthPrepass(true);
+		fragmentcounter->begin(drawView, FRAGMENT_PASS_DEPTH);
+		drawNodes();
+		fragmentcounter->end();
+		((MaterialPoint*)materialPoint)->setDepthPrepass(false);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		// only the nearest fragments pass, depth is already written
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+		fragmentcounter->begin(drawView, FRAGMENT_PASS_COLOR);
+		drawNodes();
+		fragmentcounter->end();
+		glDepthMask(GL_TRUE);
+		glDepthFunc(depthfunc);
+	}
+	else {
+		fragmentcounter->begin(drawView, FRAGMENT_PASS_COLOR);
+		drawNodes();
+		fragmentcounter->end();
+	}
+	submitTime = 0.9 * submitTime + 0.1 * (Utils::getTimeUs() - submit_start) / 1000.0;
 
 	if(option->filter != FILTER_NONE) {
 
 		frameBuffer->unbind();
 		Shader* edlShader = materialEdl->getShader();
 		edlShader->bind();
-		edlShader->transmitUniform("uColorTexture", (int)0);
-		edlShader->transmitUniform("uScreenWidth", (float)width);
-		edlShader->transmitUniform("uScreenHeight", (float)height);
-		edlShader->transmitUniform("uEdlStrength", option->filterEdl[0]);
-		edlShader->transmitUniform("uRadius", option->filterEdl[1]);
-		edlShader->transmitUniform("uOpacity", 1.0f);
-		edlShader->transmitUniform2fv("uNeighbours", ((MaterialEdl*)materialEdl)->getNeighbours());
+		edlShader->transmitUniform(UNIFORM_EDL_COLOR_TEXTURE, (int)0);
+		edlShader->transmitUniform(UNIFORM_EDL_SCREEN_WIDTH, (float)width);
+		edlShader->transmitUniform(UNIFORM_EDL_SCREEN_HEIGHT, (float)height);
+		edlShader->transmitUniform(UNIFORM_EDL_STRENGTH, option->filterEdl[0]);
+		edlShader->transmitUniform(UNIFORM_EDL_RADIUS, option->filterEdl[1]);
+		edlShader->transmitUniform(UNIFORM_EDL_OPACITY, 1.0f);
+		edlShader->transmitUniform2fv(UNIFORM_EDL_NEIGHBOURS, ((MaterialEdl*)materialEdl)->getNeighbours());
 
 		frameBuffer->getTexture("tex0")->bind();
 		
@@ -382,6 +1518,10 @@ void PointCloud::draw() {
 		materialEdl->getShader()->unbind();
 	}
 
+	// one shader variant per frame, later mode switches only swap programs
+	if(option->precompileShaders && !shadersPrecompiled)
+		shadersPrecompiled = !((MaterialPoint*)materialPoint)->precompileNext();
+
 #ifndef STANDALONE_APP
 	// draw interaction
 	if(interactMode != INTERACT_NONE) {
@@ -409,6 +1549,65 @@ void PointCloud::draw() {
 #endif
 }
 
+void PointCloud::drawNodes() {
+	if(option->batchDraw) {
+		batchrenderers[drawView]->draw(materialPoint);
+		return;
+	}
+	vector<DrawItem>& items = viewLists[drawView];
+	for(int i=0; i < items.size(); i++) {
+		items[i].node->setDrawCount(items[i].count);
+		items[i].node->draw(materialPoint);
+	}
+}
+
+// upload newly loaded nodes in display list order within the per-frame budget.
+// Nodes over budget are not drawn this frame, their parents are.
+void PointCloud::uploadNodes() {
+	unsigned long start_time = Utils::getTimeUs();
+	float level = throttle->getLevel();
+	int maxuploads = throttle->getUploadLimit();
+	unsigned int maxbytes = option->uploadBudget[0] * level * 1024 * 1024;
+	unsigned long maxtime = option->uploadBudget[1] * 1000;
+	unsigned int bytes = 0;
+
+	if(stagingring)
+		stagingring->update();
+
+	numUploads = 0;
+	uploadBacklog = 0;
+	int n = 0;
+	for(int i=0; i < pendingNodes.size(); i++) {
+		NodeGeometry* node = pendingNodes[i];
+		if(node->hasVBO())
+			continue;
+		pendingNodes[n++] = node;
+		if(!node->isLoaded())
+			continue;
+
+		// always upload at least one node so the backlog cannot stall
+		bool overbudget = (maxuploads > 0 && numUploads >= maxuploads) ||
+						  (maxbytes > 0 && bytes + node->getDataSize() > maxbytes) ||
+						  (maxtime > 0 && Utils::getTimeUs() - start_time > maxtime);
+		if(numUploads > 0 && overbudget) {
+			uploadBacklog++;
+			continue;
+		}
+
+		if(node->initVBO(bufferpool))
+			continue;
+		bytes += node->getDataSize();
+		numUploads++;
+		n--;
+	}
+	pendingNodes.resize(n);
+	if(numUploads > 0)
+		drawListChanged = true;
+
+	uploadMBPerFrame = 0.9 * uploadMBPerFrame + 0.1 * bytes / (1024.0 * 1024.0);
+	uploadTime = (Utils::getTimeUs() - start_time) / 1000.0;
+}
+
 void PointCloud::drawViewQuad()
 {
 	if (!quadVbo)
@@ -427,11 +1626,11 @@ void PointCloud::drawViewQuad()
 
 	glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
 	Shader* shader = materialEdl->getShader();
-	unsigned int attribute_vertex_pos = shader->attribute("VertexPosition");
+	unsigned int attribute_vertex_pos = shader->attribute(ATTR_EDL_POSITION);
 	glEnableVertexAttribArray(attribute_vertex_pos);
 	glVertexAttribPointer(attribute_vertex_pos, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (const GLvoid*)0);
 
-	unsigned int attribute_vertex_tex_coor = shader->attribute("VertexTexCoord");
+	unsigned int attribute_vertex_tex_coor = shader->attribute(ATTR_EDL_TEXCOORD);
 	glEnableVertexAttribArray(attribute_vertex_tex_coor);
 	glVertexAttribPointer(attribute_vertex_tex_coor, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (const GLvoid*)12);
 
@@ -468,7 +1667,8 @@ void PointCloud::traceFracture()
             (*it2).index.node->setPointColor((*it2),1,254,1);
         }
     }
-    root->initVBO();
+    if(bufferpool)
+        root->initVBO(bufferpool);
 }
 
 Point PointCloud::getPointFromIndex(const PointIndex_ &index)
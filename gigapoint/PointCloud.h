@@ -4,10 +4,20 @@
 #include "NodeGeometry.h"
 #include "Material.h"
 #include "LRU.h"
+#include "LoadErrorCache.h"
+#include "LoadThrottle.h"
+#include "BudgetGovernor.h"
 #include "Thread.h"
 #include "wqueue.h"
 #include "FrameBuffer.h"
+#include "BatchRenderer.h"
+#include "FragmentCounter.h"
+#include "OcclusionBuffer.h"
+#include "CameraPredictor.h"
+#include "AccessHeatmap.h"
+#include "CacheSnapshot.h"
 
+#include <queue>
 
 namespace gigapoint {
 
@@ -16,13 +26,20 @@ namespace gigapoint {
 
 class FractureTracer;
 
+#define MAX_VIEWS 4	// views of one multi-view traversal (eyes and tiles of a process), more draw the first
+
 struct NodeWeight {
 	NodeGeometry* node;
 	float weight;
+	int viewmask;	// views the node is selected for
+	int planemask[MAX_VIEWS];	// frustum planes the node still intersects in each view
 	
-	NodeWeight(NodeGeometry* n, float w) {
+	NodeWeight(NodeGeometry* n, float w, int views = 1) {
 		node = n;
 		weight = w;
+		viewmask = views;
+		for(int i=0; i < MAX_VIEWS; i++)
+			planemask[i] = FRUSTUM_ALL_PLANES;
 	}
 
 	bool operator<(const NodeWeight& nw) const {
@@ -30,26 +47,151 @@ struct NodeWeight {
     }
 };
 
+// one eye or tile rendered by this process
+struct View {
+	float MVP[16];
+	float campos[3];
+	int width, height;
+
+	View(): width(0), height(0) {
+		for(int i=0; i < 16; i++)
+			MVP[i] = 0;
+		campos[0] = campos[1] = campos[2] = 0;
+	}
+	View(const float mvp[16], const float cp[3], int w, int h): width(w), height(h) {
+		for(int i=0; i < 16; i++)
+			MVP[i] = mvp[i];
+		for(int i=0; i < 3; i++)
+			campos[i] = cp[i];
+	}
+};
+
+// a node and its draw count in one view
+struct DrawItem {
+	NodeGeometry* node;
+	unsigned int count;
+
+	DrawItem(NodeGeometry* n, unsigned int c): node(n), count(c) {}
+};
+
+// progress of the startup preload: nodes loaded or failed of total
+typedef void (*PreloadCallback)(int done, int total, void* data);
+
+// a camera of a scripted tour
+struct TourKeyframe {
+	float time;		// s from the start of the tour
+	View view;
+	bool selected;	// nodes are known
+	std::vector<NodeGeometry*> nodes;	// selected by a traversal against the view
+
+	TourKeyframe(float t, const View& v): time(t), view(v), selected(false) {}
+};
+
+// everything the result of a visibility traversal depends on
+struct TraversalState {
+	int numViews;
+	View views[MAX_VIEWS];
+	unsigned int pointbudget;
+	float minpixelsize;
+	float lodthreshold;
+	float pointdensity;
+	bool sortnodes;
+	float lodhysteresis;
+	bool gaze;
+	float gazeorigin[3];
+	float gazedir[3];
+	float gazefalloff[3];
+
+	TraversalState(): numViews(0), pointbudget(0), minpixelsize(0), lodthreshold(0),
+					  pointdensity(0), sortnodes(false), lodhysteresis(1), gaze(false) {
+		for(int i=0; i < 3; i++)
+			gazeorigin[i] = gazedir[i] = gazefalloff[i] = 0;
+	}
+
+	bool operator==(const TraversalState& s) const {
+		if(numViews != s.numViews)
+			return false;
+		for(int v=0; v < numViews; v++) {
+			for(int i=0; i < 16; i++)
+				if(views[v].MVP[i] != s.views[v].MVP[i])
+					return false;
+			if(views[v].width != s.views[v].width || views[v].height != s.views[v].height)
+				return false;
+		}
+		if(gaze != s.gaze)
+			return false;
+		for(int i=0; gaze && i < 3; i++)
+			if(gazeorigin[i] != s.gazeorigin[i] || gazedir[i] != s.gazedir[i] || gazefalloff[i] != s.gazefalloff[i])
+				return false;
+		return pointbudget == s.pointbudget && minpixelsize == s.minpixelsize && lodthreshold == s.lodthreshold &&
+			   pointdensity == s.pointdensity && sortnodes == s.sortnodes && lodhysteresis == s.lodhysteresis;
+	}
+};
+
+// a visibility traversal that runs for a time budget per frame and continues
+// from its queue in the next one
+struct Traversal {
+	bool active;
+	TraversalState state;
+	float V[MAX_VIEWS][6][4];
+	float pixelscale[MAX_VIEWS];
+	std::priority_queue<NodeWeight> queue;
+	std::vector<NodeGeometry*> nodes;	// display list being built, the union of all views
+	std::vector<int> viewmasks;			// views each node is drawn in
+	std::vector<unsigned int> counts;	// draw counts, numViews per node
+	std::vector<NodeGeometry*> added;	// not visible in the last complete traversal
+	unsigned int numPoints;
+	unsigned int numNodePoints;
+	int numFrames;
+	int numFlips;
+	bool occlusion;		// occluders of the last display list are valid for these views
+
+	Traversal(): active(false), numPoints(0), numNodePoints(0), numFrames(0), numFlips(0), occlusion(false) {}
+
+	void reset() {
+		active = false;
+		queue = std::priority_queue<NodeWeight>();
+		nodes.clear();
+		viewmasks.clear();
+		counts.clear();
+		added.clear();
+		numPoints = 0;
+		numNodePoints = 0;
+		numFrames = 0;
+		numFlips = 0;
+		occlusion = false;
+	}
+};
+
 class NodeLoaderThread: public Thread {    
 private:
 	wqueue<NodeGeometry*>& m_queue;
 	int maxLoadSize;
+	LoadThrottle* throttle;
+	StagingRing* ring;
+	CacheSnapshot* snapshot;
 
 public:
-	NodeLoaderThread(wqueue<NodeGeometry*>& queue, int m) : m_queue(queue), maxLoadSize(m) {}
+	NodeLoaderThread(wqueue<NodeGeometry*>& queue, int m, LoadThrottle* t, StagingRing* r, CacheSnapshot* s) :
+		m_queue(queue), maxLoadSize(m), throttle(t), ring(r), snapshot(s) {}
 
 	void* run() {
         for (;;) {
             NodeGeometry* node = (NodeGeometry*)m_queue.remove();
             if(m_queue.size() < maxLoadSize)
                 node->setState(STATE_LOADING);
-            
+
+            throttle->beginLoad();
             if(!node->isDirty()) {
-                node->loadData();
+                // a staging slot is only freed by the upload or the eviction, prefetched
+                // nodes that may never be drawn do not take one
+                node->loadData(node->isPrefetched() ? NULL : ring, snapshot);
+                throttle->endLoad(node->isLoaded() ? node->getNumPoints() : 0);
             } else {
                 node->initUpdateCache();
                 //node->updateCache->loadHierachy(); // called during update visibility
                 node->getUpdateCache()->loadData();
+                throttle->endLoad();
             }
         }
         return NULL;
@@ -75,21 +217,114 @@ private:
 	FrameBuffer* frameBuffer;
 	NodeGeometry* root;
 	std::list<NodeGeometry*> displayList;
+	std::vector<NodeGeometry*> drawList;	// displayList in drawing order
+	// per view draw lists of a multi-view traversal, in drawList order
+	int numViews;
+	std::vector<DrawItem> viewLists[MAX_VIEWS];
+	int drawView;		// view drawn by the next draw call
+	bool warnedViews;	// more contexts than MAX_VIEWS were reported
+	// gaze weighted LOD
+	bool gazeEnabled;
+	float gazeOrigin[3];
+	float gazeDirection[3];
+	// incremental visibility: the traversal is skipped while its inputs are unchanged
+	// and its result is also given as the nodes added and removed since the last one
+	TraversalState lastTraversal;
+	Traversal traversal;	// in progress, displayList stays the last complete one
+	bool needTraversal;		// forced by reloads, updates and hierarchy retries
+	unsigned int hierarchyRetryTime;	// ms, earliest retry of a failed hierarchy seen by the last traversal, 0 = none
+	unsigned int visibilityFrame;
+	std::vector<NodeGeometry*> addedNodes;
+	std::vector<NodeGeometry*> removedNodes;
+	std::vector<NodeGeometry*> pendingNodes;	// visible, not uploaded yet
+	std::vector<NodeGeometry*> residentNodes;	// left the visible set less than minResidency ago
+	int numFlips;		// nodes that came back into the visible set in the last traversal
+	int totalFlips;
+	int maxFlips;
+	string maxFlipsNode;
+	bool drawListChanged;	// the batches need to be rebuilt
+	int numTraversals;
+	int numSkippedTraversals;
+	int lastTraversalFrames;	// frames the last complete traversal took
     //int preDisplayListSize;
 	bool needReloadShader;
+	bool shadersPrecompiled;
 	bool printInfo;
 
 	Option* option;
 	int numVisibleNodes;
-	unsigned int numVisiblePoints;
+	unsigned int numVisiblePoints;	// points drawn
+	unsigned int numNodePoints;		// points in the visible nodes
 
 	// loader threads
 	wqueue<NodeGeometry*>  nodeQueue;
 	std::list<NodeLoaderThread*> nodeLoaderThreads;
 	int numLoaderThread;
 
+	// frame time aware throttling of loads and uploads
+	LoadThrottle* throttle;
+	float lastMVP[MAX_VIEWS][16];	// of every view, a tile or eye may move while another does not
+	bool cameraMoved;
+	// point budget following budgetFrameTime
+	BudgetGovernor* governor;
+
+	// streaming uploads through mapped staging buffers
+	StagingRing* stagingring;
+	// large GL buffers holding the geometry of all nodes
+	BufferPool* bufferpool;
+	BatchRenderer* batchrenderers[MAX_VIEWS];	// one batch per view, rebuilt only when it changed
+	bool batchDirty[MAX_VIEWS];
+	float submitTime;
+	FragmentCounter* fragmentcounter;
+	// CPU occlusion culling against the last display list, one buffer per view
+	OcclusionBuffer* occlusionbuffers[MAX_VIEWS];
+	int numOcclusionSkipped;	// traversals without occlusion culling after a fast turn
+	// prefetching for the extrapolated camera
+	CameraPredictor* predictor;
+	unsigned int prefetchFrame;
+	int numPrefetched;
+	int numPrefetchHits;		// prefetched nodes loaded when they became visible
+	int numPrefetchLate;		// prefetched nodes still loading when they became visible
+	int numPrefetchMisses;		// nodes that became visible without being loaded or prefetched
+	int numPrefetchCancelled;	// prefetches dropped from the queue, no longer predicted
+	int numGuardNodes;			// selected in the guard band by the last prefetch
+	bool needPrefetch;			// run a prefetch even if the traversal is skipped
+	// scripted tour, keyframes in time order
+	std::vector<TourKeyframe> tour;
+	bool tourStarted;
+	unsigned int tourStart;		// ms
+	int tourNext;				// first keyframe not passed yet
+	int numTourNodes;			// queued for keyframes by the last prefetch
+	int numTourStalls;			// passed keyframes with nodes not loaded in time
+	int numTourMissing;			// nodes of them not loaded
+	// time on screen of the nodes, the hottest of earlier sessions warm the cache at startup
+	AccessHeatmap* heatmap;
+	unsigned int lastDisplayTime;	// ms, the display list was shown since
+	std::vector<std::string> warmupNames;	// hottest first
+	int warmupNext;				// first name not resolved to a node yet
+	double warmupBytes;			// data of the resolved nodes
+	std::vector<NodeGeometry*> warmupNodes;	// resolved and not loaded yet
+	// startup preload through the loader threads
+	std::vector<NodeGeometry*> preloadNodes;	// queued, empty once all are done
+	unsigned int preloadStart;	// ms
+	int preloadDone;
+	PreloadCallback preloadCallback;
+	void* preloadCallbackData;
+	// decoded node data of the last run
+	CacheSnapshot* snapshot;
+
+	// uploads and the fragment count readback run once per frame, in the first draw after
+	// updateVisibility, whatever number of eyes and tiles draws it
+	bool newFrame;
+	// GPU upload stats
+	int numUploads;
+	int uploadBacklog;
+	float uploadMBPerFrame;
+	float uploadTime;
+
 	// cache 
 	LRUCache* lrucache;
+	LoadErrorCache* errorcache;
 
 	// interaction
 #ifndef STANDALONE_APP
@@ -111,6 +346,28 @@ private:
 
 private:
 	void initMaterials();
+	void uploadNodes();
+	void sortDrawList(const float campos[3]);
+	void startTraversal(const TraversalState& state);
+	bool continueTraversal();
+	void finishTraversal(const float campos[3]);
+	void updateVisibleSet();
+	void updatePendingNodes();
+	void updateResidentNodes();
+	void selectNodes(const View& view, float V[6][4], unsigned int pointbudget, float lodscale,
+					 float (*exclude)[4], unsigned long deadline, std::vector<NodeGeometry*>& selected);
+	void prefetch(const View& view);
+	void cancelPrefetch();
+	void addTourNodes(unsigned long deadline, std::vector<NodeGeometry*>& selected);
+	void updateTour();
+	void addWarmupNodes(unsigned long deadline, std::vector<NodeGeometry*>& selected);
+	NodeGeometry* findNode(const std::string& name);
+	void recordAccess();
+	void restoreSnapshot();
+	std::string getSnapshotKey();
+	unsigned int getDrawCount(NodeGeometry* node, const float pixelradius, const float weight = 1);
+	float getGazeWeight(NodeGeometry* node);
+	void drawNodes();
 
 
 public:
@@ -119,15 +376,46 @@ public:
 	int initPointCloud();
 	void setReloadShader(bool b) { needReloadShader = b; }
 	void setPrintInfo(bool b) { printInfo = b; }
+	void setBatchDraw(bool b) { option->batchDraw = b; }
+	void setSortNodes(bool b) { option->sortNodes = b; }
+	void setDepthPrepass(bool b) { option->depthPrepass = b; }
+	void updateFrameTime(const float frametime);
+	LoadThrottle* getThrottle() { return throttle; }
+	const std::vector<NodeGeometry*>& getAddedNodes() { return addedNodes; }
+	const std::vector<NodeGeometry*>& getRemovedNodes() { return removedNodes; }
+	BudgetGovernor* getGovernor() { return governor; }
 
 	int preloadUpToLevel(const int level=0);
+	// called with the progress of the preload, from initPointCloud or, with preloadAsync, from updateVisibility
+	void setPreloadCallback(PreloadCallback cb, void* data = NULL) { preloadCallback = cb; preloadCallbackData = data; }
+	bool updatePreload();
+	// writes the loaded nodes to cacheSnapshot, visible ones first
+	bool saveSnapshot();
+	// fraction of the preload done, 1 when there is none
+	float getPreloadProgress() { return preloadNodes.empty() ? 1 : (float)preloadDone / preloadNodes.size(); }
 	int updateVisibility(const float MVP[16], const float campos[3], const int width, const int height);
+	// one traversal against the union of the frusta of all views, with the LOD of each view
+	int updateVisibility(const View* views, int numviews);
+	// selects the draw list of a view given to updateVisibility
+	void setDrawView(int view) { drawView = view; }
+	void setViewport(int w, int h) { width = w; height = h; }
+	// LOD is concentrated within gazeFalloff of the gaze direction
+	void setGaze(const float origin[3], const float direction[3]);
+	void clearGaze() { gazeEnabled = false; }
+	int getNumViews() { return numViews; }
+	// scripted camera path: the nodes of upcoming keyframes are loaded in time order within tourMemory
+	void addTourKeyframe(float time, const View& view);
+	void startTour();
+	void clearTour();
+	// prints the estimated loading time of every keyframe at the measured I/O rate, true if the tour would stall
+	bool checkTour();
 #ifdef STANDALONE_APP
 	void draw(const float MV[16], const float MVP[16]);
 #else
     void draw();
 #endif
 	void drawViewQuad();
+	bool isOccluded(int viewmask, const float bbox[6]);
 
 
     void setReloading(bool b) {fullReload=b;}
@@ -2,6 +2,8 @@
 #include "Utils.h"
 
 #include <iostream>
+#include <stdio.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -10,25 +12,27 @@ namespace gigapoint {
 Shader::Shader(string name) {
     this->name = name;
     this->uid = -1;
-    this->vertex = NULL;
-    this->fragment = NULL;
+    this->current = NULL;
+    numCompiled = numBinaryLoads = numSwaps = 0;
 }
 
 Shader::~Shader() {
-    attributes.clear();
-    uniforms.clear();
-    delete [] vertex;
-    delete [] fragment;
+    unload();
 }
 
-Shader& Shader::load(string shaderPrefix, list<string> attributes, list<string> uniforms, const Option* option) {
-
-    unload();
+void Shader::setCacheDir(string dir) {
+    cacheDir = dir;
+    if(!cacheDir.empty())
+        mkdir(cacheDir.c_str(), 0755);
+}
 
-    string ver = "#version 120\n";
-    string fra = "#version 120\n";
+// #define switches of the variant for option, false for an unknown shader
+bool Shader::getDefines(const Option* option, string& ver, string& fra) {
+    ver = "#version 120\n";
+    fra = "#version 120\n";
 
-    if(name.compare("point") == 0) {
+    // pointdepth is the depth only variant of point for the depth prepass
+    if(name.compare("point") == 0 || name.compare("pointdepth") == 0) {
 #ifdef STANDALONE_APP
         ver.append("#define STANDALONE_APP\n");
 #endif
@@ -54,6 +58,12 @@ Shader& Shader::load(string shaderPrefix, list<string> attributes, list<string>
             fra.append("#define FILTER_EDL\n");
         }
 
+        if(name.compare("pointdepth") == 0)
+            fra.append("#define DEPTH_PREPASS\n");
+
+        // frame constants in a uniform block, the extension allows blocks in GLSL 1.20
+        if(GLEW_ARB_uniform_buffer_object)
+            ver.append("#extension GL_ARB_uniform_buffer_object : require\n#define FRAME_UNIFORM_BLOCK\n");
     }
 
     else if(name.compare("edl") == 0) {
@@ -62,49 +72,115 @@ Shader& Shader::load(string shaderPrefix, list<string> attributes, list<string>
 
     else {
         cout << "ERROR: invalid shader name" << endl;
-        return *this;
+        return false;
     }
 
-    ver.append(Utils::getFileContent(shaderPrefix+".vert"));
-    vertex = ver.c_str();
-    //cout << "vertex shader: " << endl << vertex << endl;
-    
-    fra.append(fragment = Utils::getFileContent(shaderPrefix+".frag"));
-    fragment = fra.c_str();
-    //cout << "fragment shader: " << fragment << endl;
+    return true;
+}
+
+// the shader files are read once, variants only differ in their defines
+bool Shader::readSources(string shaderPrefix) {
+    if(shaderPrefix == sourcePrefix)
+        return true;
+
+    char* vert = Utils::getFileContent(shaderPrefix+".vert");
+    char* frag = Utils::getFileContent(shaderPrefix+".frag");
+    if(vert == NULL || frag == NULL) {
+        printf("Error: Unable to load shader %s\n", shaderPrefix.c_str());
+        exit(-1);
+    }
+    vertexSource = vert;
+    fragmentSource = frag;
+    delete [] vert;
+    delete [] frag;
+    sourcePrefix = shaderPrefix;
+    return true;
+}
 
-    cout << "compile shader: " << shaderPrefix << endl;
+ShaderVariant* Shader::getVariant(string shaderPrefix, list<string>& attributes, list<string>& uniforms,
+                                  const Option* option, bool& compiled) {
+    compiled = false;
+    string ver, fra;
+    if(!getDefines(option, ver, fra))
+        return NULL;
+
+    string key = ver + fra;
+    map<string, ShaderVariant>::iterator it = variants.find(key);
+    if(it != variants.end())
+        return &it->second;
+
+    readSources(shaderPrefix);
+    ver.append(vertexSource);
+    fra.append(fragmentSource);
 
 #ifdef PRINT_DEBUG
-    printf("vertex shader:\n%s\n", vertex);
-    printf("fragment shader:\n%s\n", fragment);
+    printf("vertex shader:\n%s\n", ver.c_str());
+    printf("fragment shader:\n%s\n", fra.c_str());
 #endif
 
-    //cout << vertex << endl;
-    //cout << fragment << endl;
+    // binaries are only valid for the same driver and the same source
+    string binaryfile;
+    if(!cacheDir.empty() && GLEW_ARB_get_program_binary) {
+        string id;
+        id.append((const char*)glGetString(GL_VENDOR));
+        id.append((const char*)glGetString(GL_RENDERER));
+        id.append((const char*)glGetString(GL_VERSION));
+        id.append(ver);
+        id.append(fra);
+        char buf[16];
+        sprintf(buf, "%08x", Utils::hash(id));
+        binaryfile = cacheDir + name + "_" + buf + ".bin";
+    }
+
+    ShaderVariant variant;
+    if(!binaryfile.empty())
+        variant.uid = loadBinary(binaryfile);
+    if(variant.uid == (unsigned int)-1) {
+        cout << "compile shader: " << shaderPrefix << " (variant " << variants.size() << ")" << endl;
+        variant.uid = compile(ver, fra, binaryfile);
+        numCompiled++;
+    }
+    else {
+        numBinaryLoads++;
+    }
+    setupLocations(variant, attributes, uniforms);
+    compiled = true;
+
+    return &(variants[key] = variant);
+}
 
-    setup();
-    setupLocations(attributes, uniforms);
+Shader& Shader::load(string shaderPrefix, list<string> attributes, list<string> uniforms, const Option* option) {
+    bool compiled;
+    ShaderVariant* variant = getVariant(shaderPrefix, attributes, uniforms, option, compiled);
+    if(variant == NULL)
+        return *this;
 
+    if(!compiled)
+        numSwaps++;
+    current = variant;
+    uid = variant->uid;
     return *this;
 }
 
+bool Shader::precompile(string shaderPrefix, list<string> attributes, list<string> uniforms, const Option* option) {
+    bool compiled;
+    getVariant(shaderPrefix, attributes, uniforms, option, compiled);
+    return compiled;
+}
+
 Shader& Shader::unload() {
     glUseProgram(0);
-    if(uid != -1)
-        glDeleteProgram(uid);           
+    for(map<string, ShaderVariant>::iterator it = variants.begin(); it != variants.end(); it++)
+        glDeleteProgram(it->second.uid);
+    variants.clear();
+    current = NULL;
     uid = -1;
-    attributes.clear();
-    uniforms.clear();
     return *this;
 }
 
-Shader& Shader::setup() {
-    if (vertex == NULL || fragment == NULL)
-    {
-        printf("Error: Unable to load shader");
-        exit(-1);
-    }
+unsigned int Shader::compile(const string& ver, const string& fra, const string& binaryfile) {
+    const char* vertex = ver.c_str();
+    const char* fragment = fra.c_str();
 
     int status, logSize;
     char* log;
@@ -119,10 +195,10 @@ Shader& Shader::setup() {
     if(status != GL_TRUE)
     {
         glGetShaderiv(vshader, GL_INFO_LOG_LENGTH, &logSize);
-        log = new char[logSize - 1];
+        log = new char[logSize + 1];
         glGetShaderInfoLog(vshader, logSize, &logSize, log);
         printf("Error: Unable to compile vertex shader\n %s", log);
-        delete log;
+        delete [] log;
         exit(-1);
     }
     glAttachShader(pProgram, vshader);
@@ -130,49 +206,123 @@ Shader& Shader::setup() {
     unsigned int fshader = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fshader, 1, &fragment, NULL);
     glCompileShader(fshader);
+    glGetShaderiv(fshader, GL_COMPILE_STATUS, &status);
     if(status != GL_TRUE)
     {
         glGetShaderiv(fshader, GL_INFO_LOG_LENGTH, &logSize);
-        log = new char[logSize - 1];
+        log = new char[logSize + 1];
         glGetShaderInfoLog(fshader, logSize, &logSize, log);
         printf("Error: Unable to compile fragment shader\n  %s", log);
-        delete log;
+        delete [] log;
         exit(-1);
     }
     glAttachShader(pProgram, fshader);
 
+    if(!binaryfile.empty())
+        glProgramParameteri(pProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
     glLinkProgram(pProgram);
     glGetProgramiv(pProgram, GL_LINK_STATUS, &status);
     if(status != GL_TRUE)
     {
         glGetProgramiv(pProgram, GL_INFO_LOG_LENGTH, &logSize);
-        log = new char[logSize - 1];
+        log = new char[logSize + 1];
         glGetProgramInfoLog(pProgram, logSize, &logSize, log);
         printf("Error: Unable to link program shader \n %s", log);
         exit(-1);
     }
 
-    uid = pProgram;
+    // the program keeps the compiled code
+    glDetachShader(pProgram, vshader);
+    glDetachShader(pProgram, fshader);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
 
-    return *this;
+    if(!binaryfile.empty())
+        saveBinary(binaryfile, pProgram);
+
+    return pProgram;
+}
+
+// -1 when there is no usable binary, drivers reject binaries of other versions
+unsigned int Shader::loadBinary(const string& filename) {
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if(!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp) - sizeof(GLenum);
+    fseek(fp, 0, SEEK_SET);
+    GLenum format;
+    if(length <= 0 || fread(&format, sizeof(GLenum), 1, fp) != 1) {
+        fclose(fp);
+        return -1;
+    }
+    char* binary = new char[length];
+    size_t n = fread(binary, 1, length, fp);
+    fclose(fp);
+    if(n != length) {
+        delete [] binary;
+        return -1;
+    }
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, format, binary, length);
+    delete [] binary;
+
+    int status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(status != GL_TRUE) {
+        cout << "Shader: binary " << filename << " rejected by driver, recompiling" << endl;
+        glDeleteProgram(program);
+        return -1;
+    }
+    return program;
 }
 
-Shader& Shader::setupLocations(list<string> _attributes, list<string> _uniforms) { 
-    bind();
+void Shader::saveBinary(const string& filename, unsigned int program) {
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    char* binary = new char[length];
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary);
+
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if(fp) {
+        fwrite(&format, sizeof(GLenum), 1, fp);
+        fwrite(binary, 1, length, fp);
+        fclose(fp);
+    }
+    else {
+        cout << "Shader: cannot write binary " << filename << endl;
+    }
+    delete [] binary;
+}
 
+void Shader::setupLocations(ShaderVariant& variant, list<string>& _attributes, list<string>& _uniforms) {
     for (list<string>::iterator it=_attributes.begin(); it != _attributes.end(); ++it)
     {
         string attribute = *it;
-        attributes.insert(pair<string, unsigned int> (attribute, glGetAttribLocation(uid, attribute.c_str())));
+        unsigned int location = glGetAttribLocation(variant.uid, attribute.c_str());
+        variant.attributes.insert(pair<string, unsigned int> (attribute, location));
+        variant.attributeLocations.push_back(location);
     }
 
     for (list<string>::iterator it=_uniforms.begin(); it != _uniforms.end(); ++it)
     {
         string uniform = *it;
-        uniforms.insert(pair<string, unsigned int> (uniform, glGetUniformLocation(uid, uniform.c_str())));
+        int location = glGetUniformLocation(variant.uid, uniform.c_str());
+        variant.uniforms.insert(pair<string, unsigned int> (uniform, location));
+        variant.uniformLocations.push_back(location);
     }
+}
 
-    return *this;
+void Shader::printInfo() {
+    cout << "shader " << name << ": variants: " << variants.size() << " compiled: " << numCompiled
+         << " from binary cache: " << numBinaryLoads << " swaps: " << numSwaps << endl;
 }
 
 Shader& Shader::bind() {
@@ -190,47 +340,79 @@ string& Shader::getName() {
 }
 
 unsigned int Shader::attribute(string name) {
-    return attributes.at(name);
+    return current->attributes.at(name);
 }
 
 unsigned int Shader::uniform(string name) {
-    return uniforms.at(name);
+    return current->uniforms.at(name);
 }
 
 bool Shader::hasAttribute(string name) {
-    if (attributes.find(name) == attributes.end())
+    if (current->attributes.find(name) == current->attributes.end())
         return false;
     return true;
 }
 
 bool Shader::hasUniform(string name) {
-    if (uniforms.find(name) == uniforms.end())
+    if (current->uniforms.find(name) == current->uniforms.end())
         return false;
     return true;
 }
 
 void Shader::transmitUniform(string name, int i) {
-    glUniform1i(uniforms.at(name), i);
+    glUniform1i(current->uniforms.at(name), i);
 }
 
 void Shader::transmitUniform(string name, float f) {
-    glUniform1f(uniforms.at(name), f);
+    glUniform1f(current->uniforms.at(name), f);
 }
 
 void Shader::transmitUniform(string name, float f1, float f2) {
-    glUniform2f(uniforms.at(name), f1, f2);
+    glUniform2f(current->uniforms.at(name), f1, f2);
 }
 
 void Shader::transmitUniform(string name, float f1, float f2, float f3) {
-    glUniform3f(uniforms.at(name), f1, f2, f3);
+    glUniform3f(current->uniforms.at(name), f1, f2, f3);
 }
 
 void Shader::transmitUniform(string name, const float mat[16]) {
-    glUniformMatrix4fv(uniforms.at(name), 1, GL_FALSE, mat);
+    glUniformMatrix4fv(current->uniforms.at(name), 1, GL_FALSE, mat);
 }
 
 void Shader::transmitUniform2fv(string name, const float arr[8]) {
-    glUniform2fv(uniforms.at(name), 4, arr);
+    glUniform2fv(current->uniforms.at(name), 4, arr);
+}
+
+bool Shader::bindUniformBlock(const char* name, unsigned int binding) {
+    unsigned int index = glGetUniformBlockIndex(uid, name);
+    if(index == GL_INVALID_INDEX)
+        return false;
+    glUniformBlockBinding(uid, index, binding);
+    return true;
+}
+
+void Shader::transmitUniform(int handle, int i) {
+    glUniform1i(current->uniformLocations[handle], i);
+}
+
+void Shader::transmitUniform(int handle, float f) {
+    glUniform1f(current->uniformLocations[handle], f);
+}
+
+void Shader::transmitUniform(int handle, float f1, float f2) {
+    glUniform2f(current->uniformLocations[handle], f1, f2);
+}
+
+void Shader::transmitUniform(int handle, float f1, float f2, float f3) {
+    glUniform3f(current->uniformLocations[handle], f1, f2, f3);
+}
+
+void Shader::transmitUniform(int handle, const float mat[16]) {
+    glUniformMatrix4fv(current->uniformLocations[handle], 1, GL_FALSE, mat);
+}
+
+void Shader::transmitUniform2fv(int handle, const float arr[8]) {
+    glUniform2fv(current->uniformLocations[handle], 4, arr);
 }
 
 }; //namespace gigapoint
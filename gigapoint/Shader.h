@@ -12,25 +12,44 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 namespace gigapoint {
 
+// a linked program for one set of #define switches
+struct ShaderVariant {
+    unsigned int uid;
+    std::map<string, unsigned int> attributes;
+    std::map<string, unsigned int> uniforms;
+    std::vector<unsigned int> attributeLocations;
+    std::vector<int> uniformLocations;
+
+    ShaderVariant(): uid(-1) {}
+};
+
+// Programs are cached per variant, so switching material, quality, size type
+// or filter back and forth only compiles once. With a cache directory the
+// program binaries are also written to disk and reused by the next run.
 class Shader
 {
 public:
     Shader(string name);
     ~Shader();
 
+    // selects the variant for option, compiles it if it is not cached yet
     Shader& load(string shader, std::list<string> attributes, std::list<string> uniforms, const Option* option);
+    // compiles the variant for option without selecting it, false if it was cached already
+    bool precompile(string shader, std::list<string> attributes, std::list<string> uniforms, const Option* option);
     Shader& unload();
     Shader& bind();
     Shader& unbind();
-    Shader& setup();
-    Shader& setupLocations(std::list<string> _attributes, std::list<string> _uniforms);
 
     string& getName();
+    void setCacheDir(string dir);
+    int getNumVariants() { return variants.size(); }
+    void printInfo();
 
     unsigned int attribute(string name);
     unsigned int uniform(string name);
@@ -38,6 +57,11 @@ public:
     bool hasAttribute(string name);
     bool hasUniform(string name);
 
+    // handles are the positions in the lists given to load, resolved once at load
+    unsigned int attribute(int handle) { return current->attributeLocations[handle]; }
+    int uniform(int handle) { return current->uniformLocations[handle]; }
+    bool bindUniformBlock(const char* name, unsigned int binding);
+
     void transmitUniform(string name, int i);
     void transmitUniform(string name, float f);
     void transmitUniform(string name, float f1, float f2);
@@ -45,14 +69,36 @@ public:
     void transmitUniform(string name, const float mat[16]);
     void transmitUniform2fv(string name, const float arr[8]);
 
+    void transmitUniform(int handle, int i);
+    void transmitUniform(int handle, float f);
+    void transmitUniform(int handle, float f1, float f2);
+    void transmitUniform(int handle, float f1, float f2, float f3);
+    void transmitUniform(int handle, const float mat[16]);
+    void transmitUniform2fv(int handle, const float arr[8]);
+
 private:
     string name;
     unsigned int uid;
-    const char* vertex;
-    const char* fragment;
-    
-    std::map<string, unsigned int> attributes;
-    std::map<string, unsigned int> uniforms;
+    ShaderVariant* current;
+    std::map<string, ShaderVariant> variants;   // defines -> program
+
+    string sourcePrefix;
+    string vertexSource;
+    string fragmentSource;
+    string cacheDir;
+
+    int numCompiled;
+    int numBinaryLoads;
+    int numSwaps;
+
+    bool getDefines(const Option* option, string& ver, string& fra);
+    bool readSources(string shaderPrefix);
+    ShaderVariant* getVariant(string shaderPrefix, std::list<string>& attributes, std::list<string>& uniforms,
+                              const Option* option, bool& compiled);
+    unsigned int compile(const string& vertex, const string& fragment, const string& binaryfile);
+    unsigned int loadBinary(const string& filename);
+    void saveBinary(const string& filename, unsigned int program);
+    void setupLocations(ShaderVariant& variant, std::list<string>& attributes, std::list<string>& uniforms);
 };
 
 }; //namespace gigapoint
@@ -0,0 +1,168 @@
+#include "StagingRing.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace gigapoint {
+
+StagingRing::StagingRing(int numslots, unsigned int slotsize): slotSize(slotsize), initialized(false), supported(false),
+																numStaged(0), numFallbacks(0) {
+	pthread_mutex_init(&mutex, NULL);
+	slots.resize(numslots);
+}
+
+StagingRing::~StagingRing() {
+	pthread_mutex_destroy(&mutex);
+}
+
+bool StagingRing::init() {
+	if(initialized)
+		return supported;
+	initialized = true;
+
+	supported = GLEW_ARB_copy_buffer && GLEW_ARB_map_buffer_range && GLEW_ARB_sync;
+	if(!supported) {
+		cout << "Staging ring disabled: ARB_copy_buffer, ARB_map_buffer_range and ARB_sync are required" << endl;
+		return false;
+	}
+
+	pthread_mutex_lock(&mutex);
+	for(int i=0; i < slots.size(); i++) {
+		glGenBuffers(1, &slots[i].buffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, slots[i].buffer);
+		glBufferData(GL_COPY_READ_BUFFER, slotSize, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	pthread_mutex_unlock(&mutex);
+
+	cout << "Staging ring: " << slots.size() << " slots of " << slotSize / (1024*1024) << " MB" << endl;
+	update();
+	return true;
+}
+
+// reclaim slots whose copies have finished and map all free slots
+void StagingRing::update() {
+	if(!isEnabled())
+		return;
+
+	pthread_mutex_lock(&mutex);
+	for(int i=0; i < slots.size(); i++) {
+		StagingSlot& slot = slots[i];
+		if(slot.state == STAGING_COPYING) {
+			GLenum result = glClientWaitSync(slot.fence, 0, 0);
+			if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+				continue;
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.state = STAGING_FREE;
+		}
+		if(slot.state == STAGING_FREE) {
+			glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+			// the fence has signaled, no need for the driver to synchronise again
+			slot.ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, slotSize,
+										GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if(slot.ptr)
+				slot.state = STAGING_MAPPED;
+		}
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	pthread_mutex_unlock(&mutex);
+}
+
+void StagingRing::copy(int index, unsigned int dst0, unsigned int offset0, unsigned int size0,
+					   unsigned int dst1, unsigned int offset1, unsigned int size1) {
+	pthread_mutex_lock(&mutex);
+	StagingSlot& slot = slots[index];
+	if(slot.state != STAGING_READY) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+	if(glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE)
+		cout << "Staging ring: slot " << index << " was corrupted while mapped" << endl;
+	slot.ptr = NULL;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, dst0);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset0, size0);
+	if(size1 > 0) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, dst1);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, size0, offset1, size1);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = STAGING_COPYING;
+	numStaged++;
+	pthread_mutex_unlock(&mutex);
+}
+
+void StagingRing::destroy() {
+	if(!isEnabled())
+		return;
+
+	pthread_mutex_lock(&mutex);
+	for(int i=0; i < slots.size(); i++) {
+		StagingSlot& slot = slots[i];
+		if(slot.ptr) {
+			glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+		if(slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+		slot = StagingSlot();
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	supported = false;
+	pthread_mutex_unlock(&mutex);
+}
+
+int StagingRing::acquire(unsigned int size, void** ptr) {
+	int index = -1;
+	pthread_mutex_lock(&mutex);
+	if(isEnabled() && size <= slotSize) {
+		for(int i=0; i < slots.size(); i++) {
+			if(slots[i].state == STAGING_MAPPED) {
+				slots[i].state = STAGING_WRITING;
+				*ptr = slots[i].ptr;
+				index = i;
+				break;
+			}
+		}
+	}
+	if(index < 0)
+		numFallbacks++;
+	pthread_mutex_unlock(&mutex);
+	return index;
+}
+
+void StagingRing::commit(int index) {
+	pthread_mutex_lock(&mutex);
+	if(slots[index].state == STAGING_WRITING)
+		slots[index].state = STAGING_READY;
+	pthread_mutex_unlock(&mutex);
+}
+
+// give a slot back without copying it, it stays mapped
+void StagingRing::discard(int index) {
+	pthread_mutex_lock(&mutex);
+	if(slots[index].state == STAGING_WRITING || slots[index].state == STAGING_READY)
+		slots[index].state = STAGING_MAPPED;
+	pthread_mutex_unlock(&mutex);
+}
+
+void StagingRing::printInfo() {
+	pthread_mutex_lock(&mutex);
+	int count[STAGING_COPYING+1] = {0};
+	for(int i=0; i < slots.size(); i++)
+		count[slots[i].state]++;
+	cout << "staging ring: enabled: " << isEnabled() << " staged: " << numStaged << " fallbacks: " << numFallbacks
+		 << " slots free/mapped/writing/ready/copying: " << count[STAGING_FREE] << "/" << count[STAGING_MAPPED] << "/"
+		 << count[STAGING_WRITING] << "/" << count[STAGING_READY] << "/" << count[STAGING_COPYING] << endl;
+	pthread_mutex_unlock(&mutex);
+}
+
+}; //namespace gigapoint
@@ -0,0 +1,73 @@
+#ifndef _STAGING_RING_H_
+#define _STAGING_RING_H_
+
+#ifdef STANDALONE_APP
+#include "app/GLInclude.h"
+#else
+#include <omegaGl.h>
+#endif
+
+#include <pthread.h>
+#include <vector>
+
+namespace gigapoint {
+
+enum StagingState {
+	STAGING_FREE = 0,	// unmapped, not in use
+	STAGING_MAPPED,		// mapped, can be claimed by a loader thread
+	STAGING_WRITING,	// claimed by a loader thread
+	STAGING_READY,		// written, waiting for the render thread to copy it
+	STAGING_COPYING		// unmapped, copy in flight until the fence signals
+};
+
+struct StagingSlot {
+	unsigned int buffer;
+	void* ptr;
+	GLsync fence;
+	int state;
+
+	StagingSlot(): buffer(0), ptr(0), fence(0), state(STAGING_FREE) {}
+};
+
+// Ring of PBO-style staging buffers for streaming node uploads.
+// The render thread keeps free slots mapped, loader threads claim a slot and
+// copy decoded node data into it, and the render thread only issues
+// glCopyBufferSubData into the node buffers plus a fence per slot.
+// Needs ARB_copy_buffer, ARB_map_buffer_range and ARB_sync (works on llvmpipe).
+class StagingRing {
+
+private:
+	pthread_mutex_t mutex;
+	std::vector<StagingSlot> slots;
+	unsigned int slotSize;
+	bool initialized;
+	bool supported;
+
+	int numStaged;
+	int numFallbacks;
+
+public:
+	StagingRing(int numslots, unsigned int slotsize);
+	~StagingRing();
+
+	// render thread
+	bool init();
+	void update();
+	// copy a ready slot into dst buffers: [0, size0) -> dst0 at offset0, [size0, size0+size1) -> dst1 at offset1
+	void copy(int slot, unsigned int dst0, unsigned int offset0, unsigned int size0,
+			  unsigned int dst1, unsigned int offset1, unsigned int size1);
+	void destroy();
+
+	// loader threads: returns slot index or -1 if no slot is available
+	int acquire(unsigned int size, void** ptr);
+	void commit(int slot);
+	void discard(int slot);
+
+	bool isEnabled() { return initialized && supported; }
+	unsigned int getSlotSize() { return slotSize; }
+	void printInfo();
+};
+
+}; //namespace gigapoint
+
+#endif
@@ -19,6 +19,12 @@ unsigned int Utils::getTime() {
     return (tp.tv_sec * 1000 + tp.tv_usec / 1000);
 }
 
+unsigned long Utils::getTimeUs() {
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((unsigned long)tp.tv_sec * 1000000 + tp.tv_usec);
+}
+
 bool Utils::inCircle(const float segStart[3], const float segEnd[3], const float query[3])
 {
     float qs[3],qe[3];
@@ -174,6 +180,16 @@ char* Utils::getFileContent(string path) {
     return content;
 }
 
+// FNV-1a
+unsigned int Utils::hash(const string& str) {
+    unsigned int h = 2166136261u;
+    for(int i=0; i < str.size(); i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 float Utils::distance(const float v1[3], const float v2[3]) {
     return sqrt( (v1[0]-v2[0])*(v1[0]-v2[0]) + (v1[1]-v2[1])*(v1[1]-v2[1]) + (v1[2]-v2[2])*(v1[2]-v2[2]) );
 }
@@ -246,6 +262,50 @@ Option* Utils::loadOption(const string filename) {
 
         option->visiblePointTarget = getJsonItemDouble(json, "visiblePointTarget", 1000000);
         option->minNodePixelSize = getJsonItemDouble(json, "minNodePixelSize", 100);
+        option->pointDensity = getJsonItemDouble(json, "pointDensity", 1);
+        option->lodPixelThreshold = getJsonItemDouble(json, "lodPixelThreshold", 1);
+        option->lodHysteresis = getJsonItemDouble(json, "lodHysteresis", 0.8);
+        option->minResidency = getJsonItemInt(json, "minResidency", 2000);
+        option->prefetchTime = getJsonItemInt(json, "prefetchTime", 250);
+        option->accessHeatmap = getJsonItemString(json, "accessHeatmap", "");
+        option->warmupMemory = getJsonItemInt(json, "warmupMemory", 512);
+        option->cacheSnapshot = getJsonItemString(json, "cacheSnapshot", "");
+        option->snapshotMemory = getJsonItemInt(json, "snapshotMemory", 1024);
+        option->tourMemory = getJsonItemInt(json, "tourMemory", 512);
+        cJSON* guard = cJSON_GetObjectItem(json, "guardBand");
+        if(guard) {
+            for(int i=0; i < 4; i++)
+                option->guardBand[i] = cJSON_GetArrayItem(guard, i)->valuedouble;
+        }
+        else {
+            option->guardBand[0] = 0;
+            option->guardBand[1] = 0;
+            option->guardBand[2] = option->visiblePointTarget / 4;
+            option->guardBand[3] = 2;
+        }
+        option->traversalBudget = getJsonItemInt(json, "traversalBudget", 4000);
+        cJSON* gaze = cJSON_GetObjectItem(json, "gazeFalloff");
+        if(gaze) {
+            option->gazeFalloff[0] = cJSON_GetArrayItem(gaze, 0)->valuedouble;
+            option->gazeFalloff[1] = cJSON_GetArrayItem(gaze, 1)->valuedouble;
+            option->gazeFalloff[2] = cJSON_GetArrayItem(gaze, 2)->valuedouble;
+        }
+        else {
+            option->gazeFalloff[0] = 20;
+            option->gazeFalloff[1] = 60;
+            option->gazeFalloff[2] = 0.25;
+        }
+        option->gazeTracking = getJsonItemInt(json, "gazeTracking", 0) > 0;
+        option->budgetFrameTime = getJsonItemDouble(json, "budgetFrameTime", 0);
+        cJSON* budget = cJSON_GetObjectItem(json, "pointBudgetRange");
+        if(budget) {
+            option->pointBudgetRange[0] = cJSON_GetArrayItem(budget, 0)->valuedouble;
+            option->pointBudgetRange[1] = cJSON_GetArrayItem(budget, 1)->valuedouble;
+        }
+        else {
+            option->pointBudgetRange[0] = option->visiblePointTarget / 10;
+            option->pointBudgetRange[1] = option->visiblePointTarget * 2;
+        }
         
         string tmp = getJsonItemString(json, "material", "rgb");
         if (tmp.compare("rgb") == 0)
@@ -319,8 +379,61 @@ Option* Utils::loadOption(const string filename) {
 
         option->numReadThread = getJsonItemInt(json, "numReadThread", 2);
         option->preloadToLevel = getJsonItemInt(json, "preloadToLevel", 5);
+        option->preloadAsync = getJsonItemInt(json, "preloadAsync", 0) > 0;
         option->maxNodeInMem = getJsonItemInt(json, "maxNodeInMem", 50000);  
 	    option->maxLoadSize = getJsonItemInt(json, "maxLoadSize", 300);
+
+        cJSON* retry = cJSON_GetObjectItem(json, "loadRetryDelay");
+        if(retry) {
+            option->loadRetryDelay[0] = cJSON_GetArrayItem(retry, 0)->valueint;
+            option->loadRetryDelay[1] = cJSON_GetArrayItem(retry, 1)->valueint;
+        }
+        else {
+            option->loadRetryDelay[0] = 1000;
+            option->loadRetryDelay[1] = 60000;
+        }
+
+        option->targetFrameTime = getJsonItemDouble(json, "targetFrameTime", 0);
+        option->maxUploadsPerFrame = getJsonItemInt(json, "maxUploadsPerFrame", 100);
+        option->throttleIdleTime = getJsonItemInt(json, "throttleIdleTime", 500);
+
+        cJSON* ub = cJSON_GetObjectItem(json, "uploadBudget");
+        if(ub) {
+            option->uploadBudget[0] = cJSON_GetArrayItem(ub, 0)->valuedouble;
+            option->uploadBudget[1] = cJSON_GetArrayItem(ub, 1)->valuedouble;
+        }
+        else {
+            option->uploadBudget[0] = 32;
+            option->uploadBudget[1] = 4;
+        }
+
+        cJSON* ring = cJSON_GetObjectItem(json, "stagingRing");
+        if(ring) {
+            option->stagingRing[0] = cJSON_GetArrayItem(ring, 0)->valueint;
+            option->stagingRing[1] = cJSON_GetArrayItem(ring, 1)->valueint;
+        }
+        else {
+            option->stagingRing[0] = 0;
+            option->stagingRing[1] = 4;
+        }
+
+        option->gpuPageSize = getJsonItemInt(json, "gpuPageSize", 64);
+        option->batchDraw = getJsonItemInt(json, "batchDraw", 1) > 0;
+        option->shaderCacheDir = getJsonItemString(json, "shaderCacheDir", "");
+        if(!option->shaderCacheDir.empty())
+            option->shaderCacheDir.append("/");
+        option->precompileShaders = getJsonItemInt(json, "precompileShaders", 1) > 0;
+        option->sortNodes = getJsonItemInt(json, "sortNodes", 1) > 0;
+        option->depthPrepass = getJsonItemInt(json, "depthPrepass", 0) > 0;
+        cJSON* occlusion = cJSON_GetObjectItem(json, "occlusionBuffer");
+        if(occlusion) {
+            option->occlusionBuffer[0] = cJSON_GetArrayItem(occlusion, 0)->valueint;
+            option->occlusionBuffer[1] = cJSON_GetArrayItem(occlusion, 1)->valueint;
+        }
+        else {
+            option->occlusionBuffer[0] = 0;
+            option->occlusionBuffer[1] = 0;
+        }
         option->cameraSpeed = getJsonItemInt(json, "cameraSpeed", 10);
 
         option->cameraUpdatePosOri = getJsonItemInt(json, "cameraUpdatePosOri", 1) > 0;
@@ -388,6 +501,23 @@ void Utils::printOption(const Option* option) {
     cout << "shader dir: " << option->shaderDir << endl;
     cout << "visiblePointTarget: " << option->visiblePointTarget << endl;
     cout << "minNodePixelSize: " << option->minNodePixelSize << endl;
+    cout << "pointDensity: " << option->pointDensity << endl;
+    cout << "lodPixelThreshold: " << option->lodPixelThreshold << endl;
+    cout << "lodHysteresis: " << option->lodHysteresis << endl;
+    cout << "minResidency: " << option->minResidency << endl;
+    cout << "prefetchTime: " << option->prefetchTime << endl;
+    cout << "accessHeatmap: " << option->accessHeatmap << endl;
+    cout << "warmupMemory: " << option->warmupMemory << endl;
+    cout << "cacheSnapshot: " << option->cacheSnapshot << endl;
+    cout << "snapshotMemory: " << option->snapshotMemory << endl;
+    cout << "tourMemory: " << option->tourMemory << endl;
+    cout << "guardBand: " << option->guardBand[0] << " " << option->guardBand[1] << " " << option->guardBand[2]
+         << " " << option->guardBand[3] << endl;
+    cout << "traversalBudget: " << option->traversalBudget << endl;
+    cout << "gazeFalloff: " << option->gazeFalloff[0] << " " << option->gazeFalloff[1] << " " << option->gazeFalloff[2] << endl;
+    cout << "gazeTracking: " << option->gazeTracking << endl;
+    cout << "budgetFrameTime: " << option->budgetFrameTime << endl;
+    cout << "pointBudgetRange: " << option->pointBudgetRange[0] << " " << option->pointBudgetRange[1] << endl;
     cout << "material: " << option->material << endl;
     cout << "elevation direction: " << option->elevationDirection;
     cout << "elevation range: " << option->elevationRange[0] << " " << option->elevationRange[1] << endl;
@@ -400,8 +530,22 @@ void Utils::printOption(const Option* option) {
     cout << "cameraSpeed: " << option->cameraSpeed << endl;
     cout << "numReadThread: " << option->numReadThread << endl;
     cout << "preloadToLevel: " << option->preloadToLevel << endl;
+    cout << "preloadAsync: " << option->preloadAsync << endl;
     cout << "maxNodeInMem: " << option->maxNodeInMem << endl;
     cout << "maxLoadSize: " << option->maxLoadSize << endl;
+    cout << "loadRetryDelay: " << option->loadRetryDelay[0] << " " << option->loadRetryDelay[1] << endl;
+    cout << "targetFrameTime: " << option->targetFrameTime << endl;
+    cout << "maxUploadsPerFrame: " << option->maxUploadsPerFrame << endl;
+    cout << "throttleIdleTime: " << option->throttleIdleTime << endl;
+    cout << "uploadBudget: " << option->uploadBudget[0] << " MB " << option->uploadBudget[1] << " ms" << endl;
+    cout << "stagingRing: " << option->stagingRing[0] << " x " << option->stagingRing[1] << " MB" << endl;
+    cout << "gpuPageSize: " << option->gpuPageSize << " MB" << endl;
+    cout << "batchDraw: " << option->batchDraw << endl;
+    cout << "shaderCacheDir: " << option->shaderCacheDir << endl;
+    cout << "precompileShaders: " << option->precompileShaders << endl;
+    cout << "sortNodes: " << option->sortNodes << endl;
+    cout << "depthPrepass: " << option->depthPrepass << endl;
+    cout << "occlusionBuffer: " << option->occlusionBuffer[0] << " x " << option->occlusionBuffer[1] << endl;
     cout << "onlineUpdate: " << option->onlineUpdate << endl;
     cout << "cameraUpdatePosOri: " << option->cameraUpdatePosOri << endl;
 
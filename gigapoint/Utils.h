@@ -68,7 +68,23 @@ typedef struct Option_t {
 	string dataDir;
 	string shaderDir;
 	unsigned int visiblePointTarget;
+	float budgetFrameTime;		// ms, the point budget follows this frame time, 0: fixed visiblePointTarget
+	unsigned int pointBudgetRange[2];	// [min, max] points of the adaptive budget
+	float pointDensity;			// points per square pixel of a node's projected size, 0: draw all points
 	float minNodePixelSize;
+	float lodPixelThreshold;	// nodes are refined while their projected point spacing is larger (pixels)
+	float lodHysteresis;		// visible nodes are kept down to this fraction of the thresholds, 1: off
+	unsigned int minResidency;	// ms a node stays pinned and loaded after it left the visible set
+	unsigned int prefetchTime;	// ms ahead of the extrapolated camera nodes are loaded, 0: off
+	string accessHeatmap;		// side-car file of the time on screen of the nodes, empty: off
+	string cacheSnapshot;		// local file of the decoded nodes written at exit and restored at startup, empty: off
+	unsigned int snapshotMemory;	// MB of node data written to cacheSnapshot
+	unsigned int warmupMemory;	// MB of the hottest nodes loaded at startup
+	unsigned int tourMemory;	// MB of node data preloaded for the upcoming keyframes of a tour
+	float guardBand[4];			// [angle in degrees, near/far margin, point budget, LOD scale] of the prefetched band around the frustum
+	float gazeFalloff[3];		// [inner angle, outer angle] in degrees and LOD weight outside of the gaze
+	bool gazeTracking;			// gaze from the tracked head of the Omegalib camera
+	unsigned int traversalBudget;	// us of visibility traversal per frame, continued next frame, 0: unlimited
 	int material;
     int elevationDirection;     //0: X, 1: Y, 2: Z
 	float elevationRange[2];	//min, max in [0, 1]
@@ -79,8 +95,22 @@ typedef struct Option_t {
 	int numReadThread;
     bool onlineUpdate;
 	int preloadToLevel;
+	bool preloadAsync;		// initPointCloud returns before the preload is done
 	int maxNodeInMem;
 	int maxLoadSize;
+	unsigned int loadRetryDelay[2];	// [first retry, max retry] of failed node files in ms
+	float targetFrameTime;		// ms, 0: loads and uploads are not throttled
+	int maxUploadsPerFrame;		// 0: unlimited
+	unsigned int throttleIdleTime;	// ms without camera motion before full throughput
+	float uploadBudget[2];		// [MB, ms] of GPU uploads per frame, 0: unlimited
+	int stagingRing[2];			// [number of slots, slot size in MB], 0 slots: disabled
+	int gpuPageSize;			// MB per GL buffer of the node geometry pool
+	bool batchDraw;				// draw the display list with multi-draw calls
+	string shaderCacheDir;		// program binaries of shader variants, empty: not persisted
+	bool precompileShaders;		// compile all shader variants at startup, one per frame
+	bool sortNodes;				// draw visible nodes front to back
+	bool depthPrepass;			// depth only pass before the colour pass
+	int occlusionBuffer[2];		// [width, height] of the CPU occlusion depth buffer, 0: disabled
 	float cameraSpeed;
 	bool cameraUpdatePosOri;
 	float cameraPosition[3];
@@ -208,11 +238,13 @@ class Utils {
 
 public:
 	static unsigned int getTime();
+	static unsigned long getTimeUs();
     static bool inCircle(const float segStart[3], const float segEnd[3], const float query[3]);
 	static int testPlane(const float V[4], const float b[6]);
 	static int testFrustum(float V[6][4], const float b[6]);
 	static void getFrustum(float V[6][4], const float X[16]);
 	static char* getFileContent(std::string path);
+	static unsigned int hash(const std::string& str);
 	static float distance(const float v1[3], const float v2[3]);
 
 	// PC loader
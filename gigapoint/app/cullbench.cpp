@@ -0,0 +1,180 @@
+// Frustum culling benchmark over a synthetic octree.
+// Compares the per node Utils::testFrustum used before with FrustumCuller,
+// which inherits plane masks from the parent and tests all children of a
+// node at once over their SoA bounds.
+//
+// usage: cullbench [numnodes] [iterations]
+
+#include "../Utils.h"
+#include "../FrustumCuller.h"
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+using namespace std;
+using namespace gigapoint;
+
+// complete octree in breadth first order, the children of node k are 8k+1 .. 8k+8
+static int numNodes;
+static vector<float> bboxes;			// 6 floats per node
+static vector<ChildBounds> children;	// per internal node
+
+static void buildTree(int n) {
+	numNodes = n;
+	bboxes.resize((size_t)n * 6);
+	float root[6] = { 0, 0, 0, 1000, 1000, 1000 };
+	for(int i=0; i < 6; i++)
+		bboxes[i] = root[i];
+	for(int k=1; k < n; k++)
+		Utils::createChildAABB(&bboxes[(size_t)((k-1)/8) * 6], (k-1) % 8, &bboxes[(size_t)k * 6]);
+
+	int numinternal = (n - 2) / 8 + 1;
+	children.resize(numinternal);
+	for(int k=0; k < numinternal; k++)
+		for(int i=0; i < 8 && 8*k+1+i < n; i++)
+			children[k].set(i, &bboxes[(size_t)(8*k+1+i) * 6]);
+}
+
+// column major perspective * look at, as glm would build it
+static void buildMVP(const float eye[3], const float target[3], float fovy, float aspect, float mvp[16]) {
+	float f[3] = { target[0]-eye[0], target[1]-eye[1], target[2]-eye[2] };
+	float len = sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	for(int i=0; i < 3; i++) f[i] /= len;
+	float up[3] = { 0, 0, 1 };
+	float s[3] = { f[1]*up[2] - f[2]*up[1], f[2]*up[0] - f[0]*up[2], f[0]*up[1] - f[1]*up[0] };
+	len = sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+	for(int i=0; i < 3; i++) s[i] /= len;
+	float u[3] = { s[1]*f[2] - s[2]*f[1], s[2]*f[0] - s[0]*f[2], s[0]*f[1] - s[1]*f[0] };
+
+	float view[16] = { s[0], u[0], -f[0], 0,
+					   s[1], u[1], -f[1], 0,
+					   s[2], u[2], -f[2], 0,
+					   -(s[0]*eye[0] + s[1]*eye[1] + s[2]*eye[2]),
+					   -(u[0]*eye[0] + u[1]*eye[1] + u[2]*eye[2]),
+					   f[0]*eye[0] + f[1]*eye[1] + f[2]*eye[2], 1 };
+
+	float near = 0.1f, far = 10000.0f;
+	float t = 1.0f / tan(fovy * 0.5f);
+	float proj[16] = { t / aspect, 0, 0, 0,
+					   0, t, 0, 0,
+					   0, 0, -(far + near) / (far - near), -1,
+					   0, 0, -2.0f * far * near / (far - near), 0 };
+
+	for(int c=0; c < 4; c++)
+		for(int r=0; r < 4; r++) {
+			float v = 0;
+			for(int k=0; k < 4; k++)
+				v += proj[k*4 + r] * view[c*4 + k];
+			mvp[c*4 + r] = v;
+		}
+}
+
+static int cullScalar(float V[6][4], vector<int>& stack) {
+	int visible = 0;
+	stack.clear();
+	stack.push_back(0);
+	while(!stack.empty()) {
+		int k = stack.back();
+		stack.pop_back();
+		if(Utils::testFrustum(V, &bboxes[(size_t)k * 6]) < 0)
+			continue;
+		visible++;
+		for(int i=0; i < 8; i++) {
+			int c = 8*k + 1 + i;
+			if(c < numNodes)
+				stack.push_back(c);
+		}
+	}
+	return visible;
+}
+
+static int cullSIMD(float V[6][4], vector<int>& stack) {
+	int visible = 0;
+	stack.clear();
+	int rootmask = FrustumCuller::testBox(V, &bboxes[0]);
+	if(rootmask == FRUSTUM_OUTSIDE)
+		return 0;
+	stack.push_back(0);
+	stack.push_back(rootmask);
+	int masks[8];
+	while(!stack.empty()) {
+		int mask = stack.back();
+		stack.pop_back();
+		int k = stack.back();
+		stack.pop_back();
+		visible++;
+		if(8*k + 1 >= numNodes)
+			continue;
+		if(mask == 0) {
+			for(int i=0; i < 8; i++)
+				masks[i] = 0;
+		} else {
+			FrustumCuller::testChildren(V, children[k], mask, masks);
+		}
+		for(int i=0; i < 8; i++) {
+			int c = 8*k + 1 + i;
+			if(c < numNodes && masks[i] != FRUSTUM_OUTSIDE) {
+				stack.push_back(c);
+				stack.push_back(masks[i]);
+			}
+		}
+	}
+	return visible;
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : 10000000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10;
+	if(n < 1 || iterations < 1) {
+		cout << "usage: cullbench [numnodes] [iterations]" << endl;
+		return 1;
+	}
+
+#if defined(__AVX__)
+	cout << "cullbench: AVX" << endl;
+#elif defined(__SSE__)
+	cout << "cullbench: SSE" << endl;
+#else
+	cout << "cullbench: scalar" << endl;
+#endif
+
+	unsigned long t0 = Utils::getTimeUs();
+	buildTree(n);
+	cout << "built " << n << " nodes in " << (Utils::getTimeUs() - t0) / 1000 << " ms" << endl;
+
+	// a view from inside the cloud and one from outside looking at it
+	const float eyes[2][3] = { { 500, 500, 500 }, { -800, -600, 900 } };
+	const float targets[2][3] = { { 900, 700, 450 }, { 500, 500, 300 } };
+	vector<int> stack;
+	stack.reserve(1024);
+
+	for(int v=0; v < 2; v++) {
+		float mvp[16];
+		float V[6][4];
+		buildMVP(eyes[v], targets[v], 60.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, mvp);
+		Utils::getFrustum(V, mvp);
+
+		int visscalar = 0, vissimd = 0;
+		unsigned long tscalar = 0, tsimd = 0;
+		for(int it=0; it < iterations; it++) {
+			t0 = Utils::getTimeUs();
+			visscalar = cullScalar(V, stack);
+			tscalar += Utils::getTimeUs() - t0;
+
+			t0 = Utils::getTimeUs();
+			vissimd = cullSIMD(V, stack);
+			tsimd += Utils::getTimeUs() - t0;
+		}
+
+		cout << "view " << v << ": visible " << visscalar << " / " << vissimd
+			 << " scalar: " << tscalar / iterations / 1000.0 << " ms"
+			 << " simd: " << tsimd / iterations / 1000.0 << " ms"
+			 << " speedup: " << (tsimd > 0 ? (double)tscalar / tsimd : 0) << "x" << endl;
+		if(visscalar != vissimd)
+			cout << "warning: visible node counts differ (boundary rounding)" << endl;
+	}
+
+	return 0;
+}
@@ -107,6 +107,12 @@ static void window_size_callback(GLFWwindow* window, int width, int height) {
 	
 }
 
+static void preload_progress(int done, int total, void* data)
+{
+    if(done == total || done % 100 == 0)
+        cout << "Preload: " << done << " / " << total << " nodes" << endl;
+}
+
 void init_resources(string configfile, bool zup = false)
 {
     option = Utils::loadOption(configfile);
@@ -129,7 +135,8 @@ void init_resources(string configfile, bool zup = false)
     camera->camera_scale = option->cameraSpeed;
     camera->Update();
     
-    pointcloud = new PointCloud(option);
+    pointcloud = new PointCloud(option, true);
+    pointcloud->setPreloadCallback(preload_progress);
     pointcloud->initPointCloud();
     //pointcloud->setPrintInfo(true);
 }
@@ -170,9 +177,21 @@ void doMovement() {
     if(keys[GLFW_KEY_T]) {
         keys[GLFW_KEY_T] = false;
     }
+    if(keys[GLFW_KEY_B]) {
+        // compare submission time of batched and per node drawing (see print info)
+        option->batchDraw = !option->batchDraw;
+        cout << "batchDraw: " << option->batchDraw << endl;
+        keys[GLFW_KEY_B] = false;
+    }
     if(keys[GLFW_KEY_N]) {
         keys[GLFW_KEY_N] = false;
     }
+    if(keys[GLFW_KEY_Z]) {
+        // compare shaded fragments with and without the depth prepass (see print info)
+        option->depthPrepass = !option->depthPrepass;
+        cout << "depthPrepass: " << option->depthPrepass << endl;
+        keys[GLFW_KEY_Z] = false;
+    }
     camera->Update();
 }
 
@@ -256,6 +275,7 @@ void mainLoop()
         
         pointcloud->updateVisibility(MVP, campos, frame_width, frame_height);
         pointcloud->draw(MV, MVP);
+        pointcloud->updateFrameTime(dt * 1000);
         
         
         // draw GUI
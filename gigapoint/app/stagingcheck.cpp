@@ -0,0 +1,181 @@
+// Staging ring check over synthetic nodes.
+// A loader thread stages a batch of nodes the way NodeGeometry::stageData does,
+// the main thread copies the ready slots into one node buffer the way
+// NodeGeometry::initVBO does, waits on the fences and reads the buffer back.
+// Nodes that do not get a slot are uploaded directly, the last node is larger
+// than a slot and always takes that path.
+//
+// usage: stagingcheck [numnodes] [numslots] [slotsize in KB]
+// runs without a GPU with LIBGL_ALWAYS_SOFTWARE=1
+
+#include "../StagingRing.h"
+
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+using namespace std;
+using namespace gigapoint;
+
+struct TestNode {
+	vector<float> vertices;
+	vector<unsigned char> colors;
+	unsigned int voffset;
+	unsigned int coffset;
+	int slot;
+};
+
+struct LoaderBatch {
+	StagingRing* ring;
+	TestNode* nodes;
+	int count;
+};
+
+static void buildNode(TestNode& node, int index, unsigned int numpoints) {
+	node.vertices.resize(numpoints * 3);
+	node.colors.resize(numpoints * 3);
+	for(unsigned int i=0; i < numpoints * 3; i++) {
+		node.vertices[i] = index * 1000.0f + i * 0.5f;
+		node.colors[i] = (unsigned char)(index * 31 + i);
+	}
+	node.slot = -1;
+}
+
+// same layout as NodeGeometry::stageData: vertices followed by colors
+static void* stageBatch(void* arg) {
+	LoaderBatch* batch = (LoaderBatch*)arg;
+	for(int i=0; i < batch->count; i++) {
+		TestNode& node = batch->nodes[i];
+		unsigned int vsize = node.vertices.size()*sizeof(float);
+		unsigned int csize = node.colors.size()*sizeof(unsigned char);
+		void* ptr = NULL;
+		node.slot = batch->ring->acquire(vsize + csize, &ptr);
+		if(node.slot < 0)
+			continue;
+		memcpy(ptr, &node.vertices[0], vsize);
+		memcpy((char*)ptr + vsize, &node.colors[0], csize);
+		batch->ring->commit(node.slot);
+	}
+	return NULL;
+}
+
+static void upload(StagingRing& ring, unsigned int buffer, TestNode& node, int& numstaged, int& numdirect) {
+	unsigned int vsize = node.vertices.size()*sizeof(float);
+	unsigned int csize = node.colors.size()*sizeof(unsigned char);
+	if(node.slot >= 0) {
+		ring.copy(node.slot, buffer, node.voffset, vsize, buffer, node.coffset, csize);
+		node.slot = -1;
+		numstaged++;
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, node.voffset, vsize, &node.vertices[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, node.coffset, csize, &node.colors[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		numdirect++;
+	}
+}
+
+static bool verify(unsigned int buffer, TestNode& node) {
+	vector<float> vertices(node.vertices.size());
+	vector<unsigned char> colors(node.colors.size());
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, node.voffset, vertices.size()*sizeof(float), &vertices[0]);
+	glGetBufferSubData(GL_ARRAY_BUFFER, node.coffset, colors.size()*sizeof(unsigned char), &colors[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return vertices == node.vertices && colors == node.colors;
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : 64;
+	int numslots = argc > 2 ? atoi(argv[2]) : 4;
+	int slotkb = argc > 3 ? atoi(argv[3]) : 1024;
+	if(n < 1 || numslots < 1 || slotkb < 1) {
+		cout << "usage: stagingcheck [numnodes] [numslots] [slotsize in KB]" << endl;
+		return 1;
+	}
+	unsigned int slotsize = slotkb * 1024;
+	// 15 bytes per point, the largest regular node fills most of a slot
+	unsigned int maxpoints = slotsize / 15;
+
+	if(!glfwInit()) {
+		cout << "stagingcheck: failed to initialize GLFW" << endl;
+		return 1;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "stagingcheck", NULL, NULL);
+	if(!window) {
+		cout << "stagingcheck: failed to create a GL context" << endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = GL_TRUE;
+	if(glewInit() != GLEW_OK) {
+		cout << "stagingcheck: failed to initialize GLEW" << endl;
+		glfwTerminate();
+		return 1;
+	}
+	cout << "stagingcheck: " << glGetString(GL_RENDERER) << endl;
+
+	StagingRing ring(numslots, slotsize);
+	if(!ring.init()) {
+		glfwTerminate();
+		return 1;
+	}
+
+	// node sizes vary from one point to a full slot, the last node does not fit
+	vector<TestNode> nodes(n + 1);
+	unsigned int vtotal = 0, ctotal = 0;
+	for(int i=0; i <= n; i++) {
+		unsigned int numpoints = i < n ? 1 + (unsigned int)((i * 7919u) % maxpoints) : maxpoints + 1;
+		buildNode(nodes[i], i, numpoints);
+		nodes[i].voffset = vtotal;
+		vtotal += nodes[i].vertices.size()*sizeof(float);
+	}
+	for(int i=0; i <= n; i++) {
+		nodes[i].coffset = vtotal + ctotal;
+		ctotal += nodes[i].colors.size()*sizeof(unsigned char);
+	}
+
+	unsigned int buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, vtotal + ctotal, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// one batch per frame, as many nodes as there are slots
+	int numstaged = 0, numdirect = 0;
+	for(int first=0; first <= n; first += numslots) {
+		ring.update();
+		LoaderBatch batch = { &ring, &nodes[first], min(numslots, n + 1 - first) };
+		pthread_t thread;
+		pthread_create(&thread, NULL, stageBatch, &batch);
+		pthread_join(thread, NULL);
+		for(int i=0; i < batch.count; i++)
+			upload(ring, buffer, nodes[first + i], numstaged, numdirect);
+		// wait for the copies so that update() reclaims every slot next frame
+		glFinish();
+	}
+	ring.update();
+	ring.printInfo();
+
+	int numbad = 0;
+	for(int i=0; i <= n; i++)
+		if(!verify(buffer, nodes[i])) {
+			if(numbad < 10)
+				cout << "node " << i << " (" << nodes[i].vertices.size() / 3 << " points) differs" << endl;
+			numbad++;
+		}
+
+	glDeleteBuffers(1, &buffer);
+	ring.destroy();
+	glfwTerminate();
+
+	// every regular node must have been staged, only the oversized one is uploaded directly
+	bool ok = numbad == 0 && numstaged == n && numdirect == 1;
+	cout << "nodes: " << n + 1 << " staged: " << numstaged << " direct: " << numdirect << " corrupted: " << numbad << endl;
+	cout << (ok ? "OK" : "FAILED") << endl;
+	return ok ? 0 : 1;
+}
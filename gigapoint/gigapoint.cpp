@@ -1,20 +1,35 @@
 #include <omega.h>
 #include <omegaGl.h>
 #include <iostream>
+#include <map>
 
 #include "PointCloud.h"
 
 using namespace std;
 using namespace omega;
 
+///////////////////////////////////////////////////////////////////////////////
+static void preloadProgress(int done, int total, void* data)
+{
+    if(done == total || done % 100 == 0)
+        cout << "Gigapoint preload: " << done << " / " << total << " nodes" << endl;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 class GigapointRenderModule : public EngineModule
 {
 public:
     GigapointRenderModule() :
-        EngineModule("GigapointRenderModule"), pointcloud(0), option(0), visible(true)
+        EngineModule("GigapointRenderModule"), pointcloud(0), option(0), visible(true), frameNum(0), frameStarted(false)
     {
-    	
+        pthread_mutex_init(&tourMutex, NULL);
+        pthread_mutex_init(&frameMutex, NULL);
+    }
+
+    ~GigapointRenderModule()
+    {
+        pthread_mutex_destroy(&tourMutex);
+        pthread_mutex_destroy(&frameMutex);
     }
 
     virtual void initializeRenderer(Renderer* r);
@@ -23,7 +38,18 @@ public:
     {
         // After a frame all render passes had a chance to update their
         // textures. reset the raster update flag.
-       
+        if(pointcloud)
+            pointcloud->updateFrameTime(context.dt * 1000);
+
+        // gaze from the tracked head, in world coordinates
+        if(pointcloud && option->gazeTracking) {
+            Camera* cam = getEngine()->getDefaultCamera();
+            Vector3f pos = cam->localToWorldPosition(cam->getHeadOffset());
+            Vector3f dir = cam->localToWorldOrientation(cam->getHeadOrientation()) * -Vector3f::UnitZ();
+            float origin[3] = {pos[0], pos[1], pos[2]};
+            float direction[3] = {dir[0], dir[1], dir[2]};
+            pointcloud->setGaze(origin, direction);
+        }
     }
     
     virtual void dispose()
@@ -40,6 +66,7 @@ public:
     	//option = gigapoint::Utils::loadOption("opotree.json");
     	option = gigapoint::Utils::loadOption(option_file);
     	pointcloud = new gigapoint::PointCloud(option, SystemManager::instance()->isMaster());
+    	pointcloud->setPreloadCallback(preloadProgress);
     	pointcloud->initPointCloud();
 
     	//Camera
@@ -102,6 +129,93 @@ public:
         pointcloud->setReloadShader(false);
     }
 
+    void updatePointDensity(const float density)
+    {
+        option->pointDensity = density;
+    }
+
+    void updateLodPixelThreshold(const float pixels)
+    {
+        option->lodPixelThreshold = pixels;
+    }
+
+    void updateTraversalBudget(const int us)
+    {
+        option->traversalBudget = us;
+    }
+
+    void setGaze(const float x, const float y, const float z, const float dx, const float dy, const float dz)
+    {
+        if(!pointcloud)
+            return;
+        float origin[3] = {x, y, z};
+        float direction[3] = {dx, dy, dz};
+        pointcloud->setGaze(origin, direction);
+    }
+
+    void clearGaze()
+    {
+        if(pointcloud)
+            pointcloud->clearGaze();
+    }
+
+    void updateGazeFalloff(const float inner, const float outer, const float weight)
+    {
+        option->gazeFalloff[0] = inner;
+        option->gazeFalloff[1] = outer;
+        option->gazeFalloff[2] = weight;
+    }
+
+    // keyframe of a scripted camera path at time s from the start of the tour, with the
+    // position and orientation given to cam.setPosition and cam.setOrientation
+    void addTourKeyframe(const float time, const float x, const float y, const float z,
+                         const float qw, const float qx, const float qy, const float qz)
+    {
+        TourPose pose;
+        pose.time = time;
+        pose.position = Vector3f(x, y, z);
+        pose.orientation = Quaternion(qw, qx, qy, qz);
+        pthread_mutex_lock(&tourMutex);
+        tourPoses.push_back(pose);
+        pthread_mutex_unlock(&tourMutex);
+    }
+
+    void startTour()
+    {
+        if(pointcloud)
+            pointcloud->startTour();
+    }
+
+    void clearTour()
+    {
+        pthread_mutex_lock(&tourMutex);
+        tourPoses.clear();
+        if(pointcloud)
+            pointcloud->clearTour();
+        pthread_mutex_unlock(&tourMutex);
+    }
+
+    bool saveSnapshot()
+    {
+        if(!pointcloud)
+            return false;
+        return pointcloud->saveSnapshot();
+    }
+
+    float getPreloadProgress()
+    {
+        if(!pointcloud)
+            return 0;
+        return pointcloud->getPreloadProgress();
+    }
+
+    bool checkTour()
+    {
+        if(!pointcloud)
+            return false;
+        return pointcloud->checkTour();
+    }
+
     void updateVisible(const bool b)
     {
 	   visible = b;
@@ -148,6 +262,42 @@ public:
         pointcloud->setReloadShader(false);
     }
 
+    void setTargetFrameTime(const float ms)
+    {
+        // taken over by the throttle and the governor on the next frame
+        option->targetFrameTime = ms;
+    }
+
+    void setBudgetFrameTime(const float ms)
+    {
+        option->budgetFrameTime = ms;
+    }
+
+    int getPointBudget()
+    {
+        if(pointcloud && pointcloud->getGovernor())
+            return pointcloud->getGovernor()->getPointBudget();
+        return option->visiblePointTarget;
+    }
+
+    void updateBatchDraw(const bool b)
+    {
+        if(pointcloud)
+            pointcloud->setBatchDraw(b);
+    }
+
+    void updateSortNodes(const bool b)
+    {
+        if(pointcloud)
+            pointcloud->setSortNodes(b);
+    }
+
+    void updateDepthPrepass(const bool b)
+    {
+        if(pointcloud)
+            pointcloud->setDepthPrepass(b);
+    }
+
     void printInfo()
     {
 	if(pointcloud)
@@ -157,6 +307,54 @@ public:
     gigapoint::PointCloud* pointcloud;
     gigapoint::Option* option; 
     bool visible;
+
+    // tour keyframes not given to the point cloud yet, they need the projection of a render context
+    struct TourPose {
+        float time;
+        Vector3f position;
+        Quaternion orientation;
+    };
+    std::vector<TourPose> tourPoses;
+    pthread_mutex_t tourMutex;  // poses are added by python and taken by the render thread
+
+    // Views of all eyes and tiles of the process, shared by the render passes of all GPUs.
+    // The point cloud is used by one pass at a time under frameMutex.
+    pthread_mutex_t frameMutex;
+    uint64 frameNum;            // frame traversed last
+    bool frameStarted;
+    std::vector<gigapoint::View> frameViews;
+    std::vector<uint64> viewFrames;                     // frame each view was last drawn in
+    std::map<std::pair<const void*, int>, int> viewIndex;   // tile and eye of a context -> view
+
+    // the view of a context is replaced by its pose of this frame. Views not drawn in the last
+    // frame are dropped, so the eyes and tiles may change. Called under frameMutex.
+    int updateView(const DrawContext& context, const gigapoint::View& view, bool first)
+    {
+        if(first) {
+            for(int i=0; i < viewFrames.size(); i++) {
+                if(viewFrames[i] != frameNum) {
+                    frameViews.clear();
+                    viewFrames.clear();
+                    viewIndex.clear();
+                    break;
+                }
+            }
+        }
+        std::pair<const void*, int> key((const void*)context.tile, (int)context.eye);
+        std::map<std::pair<const void*, int>, int>::iterator it = viewIndex.find(key);
+        int index;
+        if(it == viewIndex.end()) {
+            index = frameViews.size();
+            viewIndex[key] = index;
+            frameViews.push_back(view);
+            viewFrames.push_back(context.frameNum);
+        } else {
+            index = it->second;
+            frameViews[index] = view;
+            viewFrames[index] = context.frameNum;
+        }
+        return index;
+    }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -187,15 +385,54 @@ public:
     	    { 
     			// Test and draw
     			// get camera location in world coordinate
-            	//if(context.eye == DrawContext::EyeLeft || context.eye == DrawContext::EyeCyclop)
-            	{
-                	Vector3f cp = context.camera->getPosition();
-                	float campos[3] = {cp[0], cp[1], cp[2]};
-                	float* MVP = (context.projection*context.modelview).cast<float>().data();
-                    module->pointcloud->updateVisibility(MVP, campos, context.viewport.width(), context.viewport.height());
-            	}
+                Vector3f cp = context.camera->getPosition();
+                float campos[3] = {cp[0], cp[1], cp[2]};
+                gigapoint::View view((context.projection*context.modelview).cast<float>().data(), campos,
+                                     context.viewport.width(), context.viewport.height());
+
+                pthread_mutex_lock(&module->frameMutex);
+                // first eye or tile drawn in this frame, by any render pass
+                bool first = context.frameNum != module->frameNum || !module->frameStarted;
+
+                // keyframes are seen through the first eye or tile: its view relative to the camera
+                // is moved from the current camera pose to the keyframe pose
+                if(first)
+                    pthread_mutex_lock(&module->tourMutex);
+                if(first && !module->tourPoses.empty()) {
+                    AffineTransform3 camera = AffineTransform3::Identity();
+                    camera.translate(context.camera->getPosition().cast<real>());
+                    camera.rotate(context.camera->getOrientation().cast<real>());
+                    for(int i=0; i < module->tourPoses.size(); i++) {
+                        const GigapointRenderModule::TourPose& pose = module->tourPoses[i];
+                        AffineTransform3 key = AffineTransform3::Identity();
+                        key.translate(pose.position.cast<real>());
+                        key.rotate(pose.orientation.cast<real>());
+                        AffineTransform3 modelview = context.modelview * camera * key.inverse();
+                        float keypos[3] = {pose.position[0], pose.position[1], pose.position[2]};
+                        gigapoint::View keyview((context.projection*modelview).cast<float>().data(), keypos,
+                                                context.viewport.width(), context.viewport.height());
+                        module->pointcloud->addTourKeyframe(pose.time, keyview);
+                    }
+                    module->tourPoses.clear();
+                }
+                if(first)
+                    pthread_mutex_unlock(&module->tourMutex);
+
+                // one traversal per frame for all eyes and tiles. The first context traverses with its
+                // pose of this frame, the others with theirs of the last frame (one frame of latency),
+                // and a new eye or tile is culled from the next frame on. Views are identified by
+                // tile and eye, so the order of the contexts may change.
+                int index = module->updateView(context, view, first);
+                if(first) {
+                    module->pointcloud->updateVisibility(&module->frameViews[0], module->frameViews.size());
+                    module->frameNum = context.frameNum;
+                    module->frameStarted = true;
+                }
+                module->pointcloud->setDrawView(index);
+                module->pointcloud->setViewport(view.width, view.height);
 
     		    module->pointcloud->draw();
+                pthread_mutex_unlock(&module->frameMutex);
     		    if(oglError) return;
     	    }
             
@@ -237,8 +474,26 @@ BOOST_PYTHON_MODULE(gigapoint)
     PYAPI_METHOD(GigapointRenderModule, updateQuality)
     PYAPI_METHOD(GigapointRenderModule, updateSizeType)
     PYAPI_METHOD(GigapointRenderModule, updatePointScale)
+    PYAPI_METHOD(GigapointRenderModule, updatePointDensity)
+    PYAPI_METHOD(GigapointRenderModule, updateLodPixelThreshold)
+    PYAPI_METHOD(GigapointRenderModule, updateTraversalBudget)
+    PYAPI_METHOD(GigapointRenderModule, setGaze)
+    PYAPI_METHOD(GigapointRenderModule, clearGaze)
+    PYAPI_METHOD(GigapointRenderModule, updateGazeFalloff)
+    PYAPI_METHOD(GigapointRenderModule, getPreloadProgress)
+    PYAPI_METHOD(GigapointRenderModule, saveSnapshot)
+    PYAPI_METHOD(GigapointRenderModule, addTourKeyframe)
+    PYAPI_METHOD(GigapointRenderModule, startTour)
+    PYAPI_METHOD(GigapointRenderModule, clearTour)
+    PYAPI_METHOD(GigapointRenderModule, checkTour)
     PYAPI_METHOD(GigapointRenderModule, updateVisible)
     PYAPI_METHOD(GigapointRenderModule, printInfo)
+    PYAPI_METHOD(GigapointRenderModule, setTargetFrameTime)
+    PYAPI_METHOD(GigapointRenderModule, setBudgetFrameTime)
+    PYAPI_METHOD(GigapointRenderModule, getPointBudget)
+    PYAPI_METHOD(GigapointRenderModule, updateBatchDraw)
+    PYAPI_METHOD(GigapointRenderModule, updateSortNodes)
+    PYAPI_METHOD(GigapointRenderModule, updateDepthPrepass)
     PYAPI_METHOD(GigapointRenderModule, updateFilter)
     PYAPI_METHOD(GigapointRenderModule, updateEdl)
     PYAPI_METHOD(GigapointRenderModule, updateElevationDirection)
@@ -9,6 +9,17 @@ varying vec3 vPosEye;
 
 void main() {
 
+#if defined DEPTH_PREPASS
+    // depth only, colour writes are masked. Same point shapes as the colour pass.
+#if defined CIRCLE_POINT_SHAPE || defined SPHERE_POINT_SHAPE
+    vec2 P = gl_PointCoord * 2.0 - vec2(1.0);
+    if (dot(P, P) > 1.0) {
+        discard;
+    }
+#endif
+    gl_FragColor = vec4(0.0);
+
+#else
   	gl_FragColor = vec4(vColor,1.0);
 #if defined FILTER_EDL
   	gl_FragColor.a = vDepth;
@@ -45,4 +56,5 @@ void main() {
     
 #endif
 
+#endif
 }
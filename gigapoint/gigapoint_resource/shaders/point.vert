@@ -4,6 +4,18 @@ attribute vec3 VertexColor;
 #endif
 
 uniform sampler2D uColorTexture;
+#if defined FRAME_UNIFORM_BLOCK
+// written once per frame, layout must match FrameUniforms in Material.h
+layout(std140) uniform FrameUniforms {
+    mat4 uMV;
+    mat4 uMVP;
+    vec2 uHeightMinMax;
+    vec2 uPointSizeRange;
+    float uScreenHeight;
+    float uPointScale;
+    int uElevationDirection;
+};
+#else
 uniform int uElevationDirection;
 uniform vec2 uHeightMinMax;
 uniform float uScreenHeight;
@@ -11,6 +23,10 @@ uniform float uPointScale;
 uniform vec2 uPointSizeRange;
 uniform mat4 uMV;
 uniform mat4 uMVP;
+#endif
+
+// the depth prepass and colour pass must produce the same depth
+invariant gl_Position;
 
 varying vec3 vColor;
 #if defined FILTER_EDL
@@ -12,6 +12,7 @@ template <typename T> class wqueue
 
 private:
     std::list<T>   m_queue;
+    std::list<T>   m_low;	// low priority lane, taken only while m_queue is empty
     pthread_mutex_t m_mutex;
     pthread_cond_t  m_condv;
 
@@ -40,13 +41,45 @@ public:
 	    pthread_mutex_unlock(&m_mutex);
 	}
 
+	void addLow(T item) {
+	    pthread_mutex_lock(&m_mutex);
+	    m_low.push_back(item);
+	    pthread_cond_signal(&m_condv);
+	    pthread_mutex_unlock(&m_mutex);
+	}
+
+	// moves an item of the low priority lane to the end of the queue
+	bool promote(T item) {
+	    pthread_mutex_lock(&m_mutex);
+	    bool found = false;
+	    typename std::list<T>::iterator iterator;
+	    for (iterator = m_low.begin(); iterator != m_low.end(); ++iterator) {
+	        if (*iterator == item) {
+	            m_low.erase(iterator);
+	            m_queue.push_back(item);
+	            found = true;
+	            break;
+	        }
+	    }
+	    pthread_mutex_unlock(&m_mutex);
+	    return found;
+	}
+
+	// empties the low priority lane into items
+	void takeLow(std::list<T>& items) {
+	    pthread_mutex_lock(&m_mutex);
+	    items.splice(items.end(), m_low);
+	    pthread_mutex_unlock(&m_mutex);
+	}
+
 	T remove() {
 	    pthread_mutex_lock(&m_mutex);
-	    while (m_queue.size() == 0) {
+	    while (m_queue.size() == 0 && m_low.size() == 0) {
 	        pthread_cond_wait(&m_condv, &m_mutex);
 	    }
-	    T item = m_queue.front();
-	    m_queue.pop_front();
+	    std::list<T>& lane = m_queue.size() > 0 ? m_queue : m_low;
+	    T item = lane.front();
+	    lane.pop_front();
 	    pthread_mutex_unlock(&m_mutex);
 	    return item;
 	}
@@ -57,6 +90,13 @@ public:
         pthread_mutex_unlock(&m_mutex);
         return size;
     }
+
+	int sizeLow() {
+        pthread_mutex_lock(&m_mutex);
+        int size = m_low.size();
+        pthread_mutex_unlock(&m_mutex);
+        return size;
+    }
 };
 
 }; //namespace gigapoint